@@ -11,13 +11,16 @@
 #include "nfa.h"
 
 
-void subset(struct dfa_t *dfa, struct nfa_t *nfa);
+void   classes(struct dfa_t *dfa, struct nfa_t *nfa);
+void consumers(struct dfa_t *dfa, struct nfa_t *nfa);
+void    subset(struct dfa_t *dfa, struct nfa_t *nfa);
+void  minimize(struct dfa_t *dfa);
 
 struct dfa_t *          new_dfa(int max_states);
 struct dfa_state *new_dfa_state(struct dfa_t *dfa);
 int              add_to_dstates(struct dfa_t *dfa, struct set_t *nfa_set, struct nfa_state *state);
 int                  in_dstates(struct dfa_t *dfa, struct set_t *nfa_set);
-struct dfa_state * get_unmarked(struct dfa_t *dfa);
+void              index_dstates(struct dfa_t *dfa, int nbuckets);
 
 
 /******************************************************************************
@@ -29,13 +32,16 @@ struct dfa_state * get_unmarked(struct dfa_t *dfa);
  * ```````
  * Allocate and initialize a new DFA object.
  *
- * @max  : Maximum number of states to allocate for the DFA.
+ * @max  : Initial size of the state array.
  * Return: DFA object.
+ *
+ * NOTES
+ * The transition table is allocated by subset(), once the number of
+ * columns is known, and grows along with the state array.
  */
 struct dfa_t *new_dfa(int max)
 {
         struct dfa_t *new;
-        int i;
 
         /* Allocate the dfa_t */
         if (!(new = calloc(1, sizeof(struct dfa_t))))
@@ -45,17 +51,9 @@ struct dfa_t *new_dfa(int max)
         if (!(new->state = malloc(max * sizeof(struct dfa_state *))))
                 halt(SIGABRT, "new_dfa: Out of memory.\n");
 
-        /* Allocate the transition table. [state #][character] */
-        if (!(new->trans = malloc(max * sizeof(int *))))
-                halt(SIGABRT, "new_dfa: Out of memory.\n");
-
-        for (i=0; i<max; i++) {
-                if (!(new->trans[i] = calloc(MAX_CHARS, sizeof(int))))
-                        halt(SIGABRT, "new_dfa: Out of memory.\n");
-        }
-
-        new->n   = 0;
-        new->max = max;
+        new->trans = NULL;
+        new->n     = 0;
+        new->max   = max;
 
         return new;
 }
@@ -78,17 +76,27 @@ struct dfa_state *new_dfa_state(struct dfa_t *dfa)
                 halt(SIGABRT, "new_dfa: Out of memory.\n");
 
         new->id     = dfa->n;
-        new->mark   = false;
         new->bitset = NULL; 
         new->accept = NULL;
         new->anchor = 0;
+        new->rule   = 0;
+        new->hash   = 0;
+        new->hnext  = NULL;
 
         /* Set the start state of the DFA object, if appropriate. */
         if (new->id == 0)
                 dfa->start = new;
 
-        if (new->id > dfa->max)
-                halt(SIGABRT, "new_dfa_state: State overflow\n");
+        /* Grow the state array and the transition table together. */
+        if (dfa->n == dfa->max) {
+                dfa->max *= 2;
+
+                dfa->state = realloc(dfa->state, dfa->max * sizeof(struct dfa_state *));
+                dfa->trans = realloc(dfa->trans, dfa->max * dfa->ncols * sizeof(int));
+
+                if (!dfa->state || !dfa->trans)
+                        halt(SIGABRT, "new_dfa_state: Out of memory.\n");
+        }
 
         /* Add the new state to the state array of the DFA object. */
         dfa->state[new->id] = new;
@@ -120,10 +128,20 @@ int add_to_dstates(struct dfa_t *dfa, struct set_t *nfa_set, struct nfa_state *s
 
         d = new_dfa_state(dfa);
         d->bitset = nfa_set;
+        d->hash   = set_hash(nfa_set);
+
+        /* Keep the load factor of the hash index at or below 1. */
+        if (dfa->n > dfa->nbuckets)
+                index_dstates(dfa, dfa->nbuckets ? dfa->nbuckets * 2 : 64);
+        else {
+                d->hnext = dfa->bucket[d->hash & (dfa->nbuckets - 1)];
+                dfa->bucket[d->hash & (dfa->nbuckets - 1)] = d;
+        }
 
         if (state != NULL) {
                 d->accept = state->accept;
                 d->anchor = state->anchor;
+                d->rule   = state->rule;
         }
 
         __LEAVE;
@@ -133,6 +151,34 @@ int add_to_dstates(struct dfa_t *dfa, struct set_t *nfa_set, struct nfa_state *s
 
 
 
+/**
+ * index_dstates
+ * `````````````
+ * (Re)build the hash index of DFA states with @nbuckets buckets.
+ *
+ * @dfa     : DFA object.
+ * @nbuckets: Number of buckets; must be a power of 2.
+ */
+void index_dstates(struct dfa_t *dfa, int nbuckets)
+{
+        struct dfa_state *d;
+        int i;
+
+        free(dfa->bucket);
+
+        if (!(dfa->bucket = calloc(nbuckets, sizeof(struct dfa_state *))))
+                halt(SIGABRT, "index_dstates: Out of memory.\n");
+
+        dfa->nbuckets = nbuckets;
+
+        for (i=0; i<dfa->n; i++) {
+                d = dfa->state[i];
+                d->hnext = dfa->bucket[d->hash & (nbuckets - 1)];
+                dfa->bucket[d->hash & (nbuckets - 1)] = d;
+        }
+}
+
+
 /** 
  * in_dstates
  * ``````````
@@ -141,18 +187,25 @@ int add_to_dstates(struct dfa_t *dfa, struct set_t *nfa_set, struct nfa_state *s
  * @dfa    : DFA object.
  * @nfa_set: Set of NFA state id numbers.
  * Return  : Index of DFA state containing @nfa_set, else -1.
+ *
+ * NOTE
+ * States are found through a hash index keyed on the contents of their
+ * NFA set, so the sets are only compared in full on a hash match.
  */
 int in_dstates(struct dfa_t *dfa, struct set_t *nfa_set)
 {
         struct dfa_state *d;
-        int i;
+        uint64_t hash;
 
         __ENTER;
 
-        for (i=0; i<dfa->n; i++) {
-                d = dfa->state[i];
+        if (!dfa->nbuckets)
+                return -1;
+
+        hash = set_hash(nfa_set);
 
-                if (sets_equivalent(nfa_set, d->bitset))
+        for (d = dfa->bucket[hash & (dfa->nbuckets - 1)]; d; d = d->hnext) {
+                if (d->hash == hash && sets_equivalent(nfa_set, d->bitset))
                         return d->id;
         }
 
@@ -162,29 +215,6 @@ int in_dstates(struct dfa_t *dfa, struct set_t *nfa_set)
 }
 
 
-/* 
- * get_unmarked
- * ````````````
- * Get a pointer to an unmarked state in the DFA state array.
- *
- * @dfa  : DFA object.
- * Return: Pointer to a DFA state, or NULL if none found.
- */
-struct dfa_state *get_unmarked(struct dfa_t *dfa)
-{
-        struct dfa_state *d;
-        int i;
-
-        for (i=0; i<dfa->n; i++) {
-                d = dfa->state[i];
-                if (d->mark == false) {
-	                return d;
-	        }
-        }
-        return NULL;
-}
-
-
 /**
  * accept_states
  * `````````````
@@ -199,12 +229,13 @@ struct accept_t *accept_states(struct dfa_t *dfa)
 
         __ENTER;
 
-        acc = malloc(dfa->n * sizeof(struct accept_t));
+        acc = calloc(dfa->n, sizeof(struct accept_t));
 
         for (i=0; i<dfa->n; i++) {
                 if (dfa->state[i]->accept) {
 	                acc[i].string = strdup(dfa->state[i]->accept);
 	                acc[i].anchor = dfa->state[i]->anchor;
+	                acc[i].rule   = dfa->state[i]->rule;
                 }
         }
 
@@ -234,14 +265,20 @@ struct dfa_t *do_build(struct pgen_t *pgen, struct accept_t **accept)
 
         __ENTER;
 
-        nfa = thompson(pgen->in);
-        dfa = new_dfa(DFA_MAX);
+        nfa = thompson(pgen->in, pgen->utf8, pgen->keywords);
+        dfa = new_dfa(DFA_INIT);
+        dfa->verbose = pgen->verbose;
 
+        closures(nfa);
+        classes(dfa, nfa);
+        consumers(dfa, nfa);
         subset(dfa, nfa);
+        minimize(dfa);
 
         /* --------------------- the rest is weird -------------------- */
 
         *accept = accept_states(dfa);
+        pgen->kw = nfa->kw;
 
         __LEAVE;
 
@@ -249,6 +286,155 @@ struct dfa_t *do_build(struct pgen_t *pgen, struct accept_t **accept)
 }
 
 
+/**
+ * classes
+ * ```````
+ * Partition the input characters into equivalence classes.
+ *
+ * @dfa  : DFA object; receives the class map.
+ * @nfa  : NFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * Two characters are equivalent if every edge of the NFA either accepts
+ * both of them or neither of them. Every CCL bitset and every literal
+ * edge splits the classes into those characters inside of it and those
+ * outside, so that in the end each class has one column of transitions
+ * in the DFA.
+ *
+ * Classes are numbered in order of their lowest character, which is
+ * also saved as the representative of the class in @dfa->rep.
+ */
+void classes(struct dfa_t *dfa, struct nfa_t *nfa)
+{
+        struct nfa_state *p;
+        int split[MAX_CHARS][2]; // New class of (old class, inside edge).
+        int ec[MAX_CHARS];
+        bool in;
+        int n;
+        int c;
+        int i;
+
+        __ENTER;
+
+        /* Start with a single class. */
+        for (c=0; c<MAX_CHARS; c++)
+                ec[c] = 0;
+
+        for (i=0; i<nfa->n; i++) {
+                p = nfa->state[i];
+
+                if (p->edge == EPSILON || p->edge == EMPTY)
+                        continue;
+
+                for (c=0; c<MAX_CHARS; c++)
+                        split[c][0] = split[c][1] = -1;
+
+                /* Renumber as we go; (class, in/out) pairs become classes. */
+                for (n=0, c=0; c<MAX_CHARS; c++) {
+                        in = (p->edge == CCL) ? set_contains(p->bitset, c) 
+                                              : (p->edge == c);
+
+                        if (split[ec[c]][in] == -1)
+                                split[ec[c]][in] = n++;
+
+                        ec[c] = split[ec[c]][in];
+                }
+        }
+
+        /* The renumbering above already orders classes by lowest char. */
+        for (n=0, c=0; c<MAX_CHARS; c++) {
+                if (ec[c] == n)
+                        dfa->rep[n++] = c;
+                dfa->ec[c] = ec[c];
+        }
+
+        dfa->ncols = n;
+
+        if (dfa->verbose)
+                fprintf(stderr, "DFA: %d character classes.\n", n);
+
+        __LEAVE;
+}
+
+
+/**
+ * consumers
+ * `````````
+ * Build the inverted index from each character class to the NFA states
+ * with an edge on that class.
+ *
+ * @dfa  : DFA object, with its classes computed; receives the index.
+ * @nfa  : NFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * The index is kept in one array, class by class: the consumers of
+ * class c are @dfa->cons[@dfa->cons_n[c] .. @dfa->cons_n[c+1]), in
+ * increasing order of state id. Since every character of a class is
+ * on the same edges, testing the representative of the class is enough.
+ */
+void consumers(struct dfa_t *dfa, struct nfa_t *nfa)
+{
+        struct nfa_state *p;
+        int *fill;
+        int c;
+        int i;
+
+        __ENTER;
+
+        dfa->cons_n = calloc(dfa->ncols + 1, sizeof(int));
+        fill        = malloc(dfa->ncols * sizeof(int));
+
+        if (!dfa->cons_n || !fill)
+                halt(SIGABRT, "consumers: Out of memory.\n");
+
+        #define CONSUMES(p,c) \
+                ((p)->edge == CCL ? set_contains((p)->bitset, dfa->rep[c]) \
+                                  : (p)->edge == dfa->rep[c])
+
+        /* Count the consumers of each class... */
+        for (i=0; i<nfa->n; i++) {
+                p = nfa->state[i];
+
+                if (p->edge == EPSILON || p->edge == EMPTY)
+                        continue;
+
+                for (c=0; c<dfa->ncols; c++) {
+                        if (CONSUMES(p, c))
+                                dfa->cons_n[c+1]++;
+                }
+        }
+        for (c=0; c<dfa->ncols; c++)
+                dfa->cons_n[c+1] += dfa->cons_n[c];
+
+        if (!(dfa->cons = malloc((dfa->cons_n[dfa->ncols] + 1) * sizeof(int))))
+                halt(SIGABRT, "consumers: Out of memory.\n");
+
+        /* ...then list them. */
+        for (c=0; c<dfa->ncols; c++)
+                fill[c] = dfa->cons_n[c];
+
+        for (i=0; i<nfa->n; i++) {
+                p = nfa->state[i];
+
+                if (p->edge == EPSILON || p->edge == EMPTY)
+                        continue;
+
+                for (c=0; c<dfa->ncols; c++) {
+                        if (CONSUMES(p, c))
+                                dfa->cons[fill[c]++] = i;
+                }
+        }
+
+        #undef CONSUMES
+
+        free(fill);
+
+        __LEAVE;
+}
+
+
 /**
  * subset
  * ``````
@@ -257,48 +443,471 @@ struct dfa_t *do_build(struct pgen_t *pgen, struct accept_t **accept)
  * @dfa  : DFA object.
  * @nfa  : NFA object.
  * Return: Nothing.
+ *
+ * NOTES
+ * States are expanded from a FIFO worklist. Since add_to_dstates()
+ * appends each new state to dfa->state[], that array is itself the
+ * queue: states below @head have been expanded, and those from @head
+ * to dfa->n are waiting.
+ *
+ * This makes the numbering a breadth-first one, and deterministic:
+ * state 0 is the start state, and every other state is numbered in
+ * the order it is first reached when the states are expanded in
+ * ascending order, each on its characters in ascending order.
+ * minimize() keeps the relative order of the states it keeps, so
+ * tables generated from the same input always come out the same.
+ *
+ * Transitions are computed once per character class, using the lowest
+ * character of the class, since every character of a class moves the
+ * NFA the same way (see classes()).
+ *
+ * The sets of NFA states being moved and closed over are sparse sets,
+ * so the work is proportional to the states in them rather than to the
+ * size of the NFA. A set is only written out as a bitset (@key) to look
+ * it up among the DFA states, and copied only if it makes a new state.
+ *
+ * move() is handed the consumers of each class (see consumers()), so a
+ * set is only intersected with the states that have an edge on it.
  */
 void subset(struct dfa_t *dfa, struct nfa_t *nfa)
 {
         struct dfa_state *current; // state currently being expanded
         struct nfa_state *accept;
+        struct sparse_t *cur;      // NFA states of the current DFA state
+        struct sparse_t *next;     // NFA states reached on a character class
+        struct set_t *key;         // canonical (bitset) form of @next
         struct set_t *nfa_set;     // set of NFA states that define next DFA state
         int nextstate;             // goto DFA state for current char
+        int head;                  // next state to take from the worklist
         int c;                     // input char
+        int i;
 
         __ENTER;
 
-        nfa_set = new_set(MAX_CHARS) ;
+        if (!(dfa->trans = malloc(dfa->max * dfa->ncols * sizeof(int))))
+                halt(SIGABRT, "subset: Out of memory.\n");
+
+        cur  = new_sparse(nfa->n);
+        next = new_sparse(nfa->n);
+        key  = new_set(nfa->n);
 
         /* Make the dfa start state. */
-        set_add(nfa_set, nfa->start->id);
-        accept = e_closure(nfa, nfa_set);
+        sparse_add(next, nfa->start->id);
+        accept  = e_closure(nfa, next);
+        nfa_set = new_set(nfa->n);
+        sparse_store(next, nfa_set);
         add_to_dstates(dfa, nfa_set, accept);
 
         /* Make the table */
-        while ((current = get_unmarked(dfa))) {
+        for (head=0; head<dfa->n; head++) {
 
-	        current->mark = true;
+                current = dfa->state[head];
+                sparse_load(cur, current->bitset);
 
-	        for (c=0; c<MAX_CHARS; c++) {
+	        for (c=0; c<dfa->ncols; c++) {
 
-	                if ((nfa_set = move(nfa, current->bitset, c))) {
-		                accept = e_closure(nfa, nfa_set);
-                        }
-
-	                if (!nfa_set) 
+	                if (!move(nfa, cur, dfa->rep[c], 
+                                  &dfa->cons[dfa->cons_n[c]], 
+                                  dfa->cons_n[c+1] - dfa->cons_n[c], next)) {
 		                nextstate = F;
-	                else if ((nextstate = in_dstates(dfa, nfa_set)) != -1)
-                                free(nfa_set);
-                        else
-		                nextstate = add_to_dstates(dfa, nfa_set, accept);
+                        } else {
+		                accept = e_closure(nfa, next);
+
+                                sparse_store(next, key);
+
+	                        if ((nextstate = in_dstates(dfa, key)) == -1) {
+                                        nfa_set = new_set(nfa->n);
+                                        set_assignment(nfa_set, key);
+		                        nextstate = add_to_dstates(dfa, nfa_set, accept);
+                                }
 
-	                dfa->trans[current->id][c] = nextstate;
+                                /* Clear the key by its members only. */
+                                for (i=0; i<next->n; i++)
+                                        set_pop(key, next->dense[i]);
+                        }
+
+	                dfa->trans[current->id * dfa->ncols + c] = nextstate;
 	        }
         }
-        /* Terminate string of *'s printed in get_unmarked(); */
-        putc('\n', stderr);   	
+
+        del_sparse(cur);
+        del_sparse(next);
+        free(key->map);
+        free(key);
+
+        /* Nor is the index of consumers. */
+        free(dfa->cons);
+        free(dfa->cons_n);
+        dfa->cons   = NULL;
+        dfa->cons_n = NULL;
+
+        /* The index is only needed while the states are being built. */
+        free(dfa->bucket);
+        dfa->bucket   = NULL;
+        dfa->nbuckets = 0;
 
         __LEAVE;
 }
 
+
+
+/******************************************************************************
+ * DFA MINIMIZATION 
+ ******************************************************************************/
+
+/**
+ * partition
+ * `````````
+ * A refinable partition of the DFA states, used by minimize().
+ *
+ * The states of each block are kept contiguous in @elem, between
+ * @first[b] and @end[b]. States marked during a splitting pass are
+ * swapped to the front of their block, and @mid[b] points one past
+ * the last marked state.
+ */
+struct partition {
+        int *elem;   // States, grouped by block.
+        int *loc;    // Position of each state in @elem.
+        int *block;  // Block containing each state.
+        int *first;  // Start of each block in @elem.
+        int *end;    // One past the end of each block in @elem.
+        int *mid;    // One past the last marked state of each block.
+        int n;       // Number of blocks.
+};
+
+
+/**
+ * mark_state
+ * ``````````
+ * Mark state @s in its block, remembering the block if it is the
+ * first state of the block to be marked.
+ *
+ * @P      : The partition.
+ * @s      : State to mark.
+ * @touched: Stack of blocks having at least one marked state.
+ * @ntouch : Number of blocks on @touched.
+ */
+static void mark_state(struct partition *P, int s, int *touched, int *ntouch)
+{
+        int b = P->block[s];
+        int i = P->loc[s];
+        int j = P->mid[b];
+        int t;
+
+        /* Already marked */
+        if (i < j)
+                return;
+
+        if (j == P->first[b])
+                touched[(*ntouch)++] = b;
+
+        /* Swap @s with the first unmarked state of the block. */
+        t          = P->elem[j];
+        P->elem[j] = s;
+        P->elem[i] = t;
+        P->loc[s]  = j;
+        P->loc[t]  = i;
+
+        P->mid[b]++;
+}
+
+
+/**
+ * split_block
+ * ```````````
+ * Split the marked states of block @b off into a new block.
+ *
+ * @P    : The partition.
+ * @b    : Block to split.
+ * Return: Index of the new block, or -1 if every state was marked.
+ */
+static int split_block(struct partition *P, int b)
+{
+        int nb;
+        int i;
+
+        /* Every state is marked; nothing to split. */
+        if (P->mid[b] == P->end[b]) {
+                P->mid[b] = P->first[b];
+                return -1;
+        }
+
+        nb = P->n++;
+
+        P->first[nb] = P->first[b];
+        P->end[nb]   = P->mid[b];
+        P->mid[nb]   = P->first[nb];
+
+        P->first[b]  = P->mid[b];
+
+        for (i=P->first[nb]; i<P->end[nb]; i++)
+                P->block[P->elem[i]] = nb;
+
+        return nb;
+}
+
+
+/*
+ * Compare two DFA states by accept action, then by anchor, so that
+ * states which must never be merged sort into different runs.
+ */
+static struct dfa_t *sort_dfa;
+
+static int accept_cmp(const void *a, const void *b)
+{
+        struct dfa_state *x = sort_dfa->state[*(const int *)a];
+        struct dfa_state *y = sort_dfa->state[*(const int *)b];
+
+        if (x->accept != y->accept)
+                return (x->accept < y->accept) ? -1 : 1;
+        if (x->anchor != y->anchor)
+                return (x->anchor < y->anchor) ? -1 : 1;
+
+        return *(const int *)a - *(const int *)b;
+}
+
+
+/**
+ * minimize
+ * ````````
+ * Merge equivalent states of the DFA using Hopcroft's partition
+ * refinement algorithm.
+ *
+ * @dfa  : DFA object produced by subset().
+ * Return: Nothing; @dfa is rewritten with the minimal set of states.
+ *
+ * NOTES
+ * The transition table produced by subset() is partial, with F marking
+ * a failed transition. To make the machine complete, a dead state (with
+ * index @dfa->n) is added that absorbs every failed transition and
+ * loops on itself. It starts in the same block as the non-accepting
+ * states, and any block it ends up in reverts to F in the output.
+ *
+ * The initial partition places accepting states in separate blocks per
+ * distinct accept action and anchor. Rule priority was already resolved
+ * by e_closure() when the action was chosen, so two states can only be
+ * merged if they would run the same action under the same anchoring.
+ *
+ * Blocks are numbered in order of the lowest state they contain, so the
+ * start state stays 0 and the output does not depend on the order in
+ * which blocks were split.
+ */
+void minimize(struct dfa_t *dfa)
+{
+        struct partition P;
+        int *order;     // States sorted by accept action.
+        int *pred;      // Predecessors, grouped by (class, target).
+        int *pred_n;    // Start of each (class, target) group in pred.
+        int *work;      // Blocks waiting to be used as splitters.
+        bool *in_work;  // Block is on the work stack.
+        int *touched;   // Blocks with marked states in this pass.
+        int *splitter;  // Snapshot of the splitter's states.
+        int *newid;     // Block -> state number in the minimal DFA.
+        int *row;
+        int nwork;
+        int ntouch;
+        int nsplit;
+        int nstates;
+        int dead;
+        int b, nb;
+        int s, t, c, i, j, k;
+
+        __ENTER;
+
+        nstates = dfa->n + 1;
+        dead    = dfa->n;
+
+        P.elem  = malloc(nstates * sizeof(int));
+        P.loc   = malloc(nstates * sizeof(int));
+        P.block = malloc(nstates * sizeof(int));
+        P.first = malloc(nstates * sizeof(int));
+        P.end   = malloc(nstates * sizeof(int));
+        P.mid   = malloc(nstates * sizeof(int));
+        P.n     = 0;
+
+        order    = malloc(nstates * sizeof(int));
+        work     = malloc(nstates * sizeof(int));
+        in_work  = calloc(nstates, sizeof(bool));
+        touched  = malloc(nstates * sizeof(int));
+        splitter = malloc(nstates * sizeof(int));
+        newid    = malloc(nstates * sizeof(int));
+        pred     = malloc(nstates * dfa->ncols * sizeof(int));
+        pred_n   = calloc(nstates * dfa->ncols + 1, sizeof(int));
+
+        if (!P.elem || !P.loc || !P.block || !P.first || !P.end || !P.mid
+        ||  !order || !work || !in_work || !touched || !splitter || !newid
+        ||  !pred || !pred_n)
+                halt(SIGABRT, "minimize: Out of memory.\n");
+
+        /* 
+         * Invert the transition table. The predecessors of state t on
+         * class c are pred[pred_n[c*nstates+t] .. pred_n[c*nstates+t+1]).
+         */
+        #define TARGET(s,c) \
+                (((s) == dead || dfa->trans[(s)*dfa->ncols + (c)] == F) \
+                        ? dead : dfa->trans[(s)*dfa->ncols + (c)])
+
+        for (s=0; s<nstates; s++) {
+                for (c=0; c<dfa->ncols; c++)
+                        pred_n[c*nstates + TARGET(s,c) + 1]++;
+        }
+        for (i=0; i<nstates*dfa->ncols; i++)
+                pred_n[i+1] += pred_n[i];
+
+        for (s=0; s<nstates; s++) {
+                for (c=0; c<dfa->ncols; c++)
+                        pred[pred_n[c*nstates + TARGET(s,c)]++] = s;
+        }
+        /* Filling advanced each start to the next group's; shift back. */
+        for (i=nstates*dfa->ncols; i>0; i--)
+                pred_n[i] = pred_n[i-1];
+        pred_n[0] = 0;
+
+        /* 
+         * Initial partition. Non-accepting states (and the dead state)
+         * sort first, since their accept pointer is NULL.
+         */
+        sort_dfa = dfa;
+        for (s=0; s<dfa->n; s++)
+                order[s] = s;
+        qsort(order, dfa->n, sizeof(int), accept_cmp);
+
+        P.elem[0]     = dead;
+        P.loc[dead]   = 0;
+        P.block[dead] = 0;
+        P.first[0]    = 0;
+        P.n           = 1;
+
+        for (i=0; i<dfa->n; i++) {
+                s = order[i];
+                t = (i == 0) ? dead : order[i-1];
+
+                if (dfa->state[s]->accept != ((t == dead) ? NULL : dfa->state[t]->accept)
+                ||  dfa->state[s]->anchor != ((t == dead) ? 0    : dfa->state[t]->anchor)) {
+                        P.end[P.n-1] = i+1;
+                        P.first[P.n] = i+1;
+                        P.n++;
+                }
+                P.elem[i+1] = s;
+                P.loc[s]    = i+1;
+                P.block[s]  = P.n-1;
+        }
+        P.end[P.n-1] = nstates;
+
+        for (b=0; b<P.n; b++)
+                P.mid[b] = P.first[b];
+
+        /* Every initial block is a potential splitter. */
+        for (nwork=0; nwork<P.n; nwork++) {
+                work[nwork]    = nwork;
+                in_work[nwork] = true;
+        }
+
+        /* Refine until no block can be split. */
+        while (nwork > 0) {
+                b = work[--nwork];
+                in_work[b] = false;
+
+                nsplit = 0;
+                for (i=P.first[b]; i<P.end[b]; i++)
+                        splitter[nsplit++] = P.elem[i];
+
+                for (c=0; c<dfa->ncols; c++) {
+                        ntouch = 0;
+
+                        for (i=0; i<nsplit; i++) {
+                                t = c*nstates + splitter[i];
+                                for (j=pred_n[t]; j<pred_n[t+1]; j++)
+                                        mark_state(&P, pred[j], touched, &ntouch);
+                        }
+
+                        for (k=0; k<ntouch; k++) {
+                                b  = touched[k];
+                                if ((nb = split_block(&P, b)) == -1)
+                                        continue;
+
+                                if (in_work[b]) {
+                                        work[nwork++] = nb;
+                                        in_work[nb]   = true;
+                                } else if (P.end[nb] - P.first[nb] < P.end[b] - P.first[b]) {
+                                        work[nwork++] = nb;
+                                        in_work[nb]   = true;
+                                } else {
+                                        work[nwork++] = b;
+                                        in_work[b]    = true;
+                                }
+                        }
+                }
+        }
+
+        /* 
+         * Number the surviving blocks by their lowest state. Walking the
+         * states in order visits each block first through that state,
+         * which becomes the representative of its block.
+         *
+         * A representative never moves up, so the state array and the
+         * table can be compacted in place, releasing merged states as
+         * they are passed.
+         */
+        for (b=0; b<P.n; b++)
+                newid[b] = F;
+
+        for (k=0, s=0; s<dfa->n; s++) {
+                b = P.block[s];
+                if (s == 0 && b == P.block[dead]) {
+                        /* 
+                         * No rule can match. Keep the start state, 
+                         * with no way out of it, as the only state.
+                         */
+                        for (c=0; c<dfa->ncols; c++)
+                                dfa->trans[c] = F;
+                        k++;
+                } else if (b != P.block[dead] && newid[b] == F) {
+                        newid[b]          = k;
+                        dfa->state[k]     = dfa->state[s];
+                        dfa->state[k]->id = k;
+                        memmove(&dfa->trans[k * dfa->ncols], 
+                                &dfa->trans[s * dfa->ncols], 
+                                dfa->ncols * sizeof(int));
+                        k++;
+                } else {
+                        free(dfa->state[s]->bitset->map);
+                        free(dfa->state[s]->bitset);
+                        free(dfa->state[s]);
+                }
+        }
+
+        /* Re-target the transitions of each surviving state. */
+        for (i=0; i<k; i++) {
+                row = &dfa->trans[i * dfa->ncols];
+                for (c=0; c<dfa->ncols; c++) {
+                        if ((t = row[c]) != F)
+                                row[c] = newid[P.block[t]];
+                }
+        }
+
+        if (dfa->verbose)
+                fprintf(stderr, "DFA: %d states, %d after minimization.\n", dfa->n, k);
+
+        dfa->start = dfa->state[0];
+        dfa->n     = k;
+
+        free(P.elem);
+        free(P.loc);
+        free(P.block);
+        free(P.first);
+        free(P.end);
+        free(P.mid);
+        free(order);
+        free(work);
+        free(in_work);
+        free(touched);
+        free(splitter);
+        free(newid);
+        free(pred);
+        free(pred_n);
+
+        #undef TARGET
+
+        __LEAVE;
+}
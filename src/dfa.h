@@ -1,6 +1,7 @@
 #ifndef _DFA_H
 #define _DFA_H
 
+#include <stdint.h>
 #include "main.h"
 #include "lex.h"
 
@@ -10,16 +11,10 @@
  ******************************************************************************/
 
 /* 
- * Maximum number of states in a single
- * finite state machine. 
+ * Initial size of the state array of a DFA.
+ * It is doubled whenever it fills up.
  */
-#define DFA_MAX 254 
-
-/*
- * Maximum width (number of columns) in a
- * DFA's transition table.
- */
-#define MAX_CHARS 128 
+#define DFA_INIT 256 
 
 /* 
  * Denotes a failure state in the transition 
@@ -34,11 +29,12 @@
 
 /**
  * Contains an accepting string, which is NULL if non-accepting,
- * and an anchor point, if any.
+ * an anchor point, if any, and the number of the rule.
  */
 struct accept_t {
         char *string;
         int   anchor;
+        int   rule;
 };
 
 
@@ -50,10 +46,12 @@ struct accept_t {
  */
 struct dfa_state {
         int id;
-        bool mark;            // Used by make_dtran.
-        char *accept;         // Action if the state is accepting.
-        int anchor;           // Anchor point for accept.
-        struct set_t *bitset; // Set of NFA states in this DFA state.
+        char *accept;            // Action if the state is accepting.
+        int anchor;              // Anchor point for accept.
+        int rule;                // Rule that @accept belongs to.
+        struct set_t *bitset;    // Set of NFA states in this DFA state.
+        uint64_t hash;           // Hash of @bitset, see set_hash().
+        struct dfa_state *hnext; // Next state in the same hash bucket.
 };
 
 
@@ -63,11 +61,19 @@ struct dfa_state {
  * The actual DFA object. 
  */
 struct dfa_t {
-        struct dfa_state *start;  // DFA start state. 
-        struct dfa_state **state; // Array of DFA states.
-        int **trans;              // Transitions between states.
-        int n;
-        int max;
+        struct dfa_state *start;   // DFA start state. 
+        struct dfa_state **state;  // Array of DFA states.
+        int *trans;                // Transitions, trans[state * ncols + class].
+        int n;                     // Number of states.
+        int max;                   // Allocated size of @state and @trans.
+        struct dfa_state **bucket; // Hash index of states by NFA set.
+        int nbuckets;              // Number of buckets (a power of 2).
+        int ec[MAX_CHARS];         // Equivalence class of each character.
+        int rep[MAX_CHARS];        // Lowest character in each class.
+        int ncols;                 // Number of classes (table width).
+        int *cons;                 // NFA states consuming each class, see consumers().
+        int *cons_n;               // Class c's are cons[cons_n[c] .. cons_n[c+1]).
+        bool verbose;              // Report the sizes of the tables (-v).
 };
 
 
@@ -8,24 +8,95 @@
  ******************************************************************************/
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+
+#include "input.h"
 
 /******************************************************************************
  * Global variables and settings
  ******************************************************************************/
 
-typedef unsigned char YY_TTYPE;
-#define YYF ((YY_TTYPE)(-1))
+/* YY_TTYPE and YYF are defined along with the tables. */
 #define YYPRIVATE static
 
-unsigned char *yytext; /* Pointer to lexeme. */
-int yylen;    /* Length of lexeme. */
-int yylineno; /* Input line number. */
+/*
+ * Everything a scanner changes as it runs is in its yy_scan, and the
+ * tables are shared, so that any number of scanners can run at once;
+ * each has to be run from one thread at a time.
+ */
+struct yy_scan {
+        struct io_t *io;     /* Input of the scanner. */
+        unsigned char *text; /* Pointer to lexeme. */
+        int len;             /* Length of lexeme. */
+        int lineno;          /* Input line number. */
+        bool begun;          /* The input has been primed. */
+        #ifdef YY_BADCOUNT
+        unsigned long badcount; /* Characters skipped as bad input. */
+        #endif
+        #ifdef YY_PARALLEL
+        struct yy_par *par;  /* State of a parallel scan, if it is one. */
+        #endif
+        #ifdef YY_PUSH
+        struct yy_push *push; /* State of a push scan, if it is one. */
+        #endif
+};
+
+typedef struct yy_scan *yyscan_t;
+
+/*
+ * The scanner that yylex() runs. The actions see the scanner they are
+ * run by as yyscanner, and the code outside of them sees this one.
+ */
+YYPRIVATE struct yy_scan yy_std;
+yyscan_t yyscanner = &yy_std;
+
+#define yytext   (yyscanner->text)
+#define yylen    (yyscanner->len)
+#define yylineno (yyscanner->lineno)
+
+/*
+ * If YY_MMAP is defined, input files are mapped rather than read (see
+ * io_newmap()). yytext then points into the file, and isn't terminated,
+ * as it is when the input is a buffer in memory (see yy_init_buffer()).
+ * Otherwise, if YY_AHEAD is defined, input files are read ahead of the
+ * scanner on a thread of their own (see io_newahead()).
+ */
+#ifdef YY_MMAP
+#define yy_open_r io_newmap_r
+#elif defined(YY_AHEAD)
+#define yy_open_r io_newahead_r
+#else
+#define yy_open_r io_newfile_r
+#endif
+
+/*
+ * If YY_BUFSIZE is defined, it is the size of the input buffer (see
+ * io_bufsize()). The buffer grows to hold a longer lexeme in any case.
+ */
+#ifdef YY_BUFSIZE
+#define yy_bufsize_r(io) io_bufsize_r(io, YY_BUFSIZE)
+#else
+#define yy_bufsize_r(io) ((void)(io))
+#endif
 
 /* Output file (default is stdout) */
 #define yyout stdout
 
 
+/*
+ * Count the characters skipped as bad input, if YY_BADCOUNT is defined.
+ * Each scanner keeps its own count.
+ */
+#ifdef YY_BADCOUNT
+#define yybadcount (yyscanner->badcount)
+#define YY_BAD(n)  (yybadcount += (n))
+#else
+#define YY_BAD(n) ((void)(n))
+#endif
+
+
 /* Debugging routines */
 #ifndef YY_ERROR
 #define YY_ERROR(t) fprintf(stderr, "ERROR: %s", t)
@@ -34,12 +105,15 @@ int yylineno; /* Input line number. */
 
 /* Output macros */
 #define output(c) putc(c, yyout)
-#define ECHO fprintf(yyout, "%s", yytext)
+#define ECHO fwrite(yytext, 1, yylen, yyout)
 
 /* Pushback macros */
 #define yymore()  yymoreflg = 1
-#define unput(c)  (io_unput(c), --yylen)
-#define yyless(n) (io_unterm(), (yylen -= io_pushback(n) ? n : yylen), io_term())
+#define unput(c)  (io_unput_r(yyscanner->io, c), --yylen)
+#define yyless(n) (io_unterm_r(yyscanner->io), (yylen -= io_pushback_r(yyscanner->io, n) ? n : yylen), io_term_r(yyscanner->io))
+
+/* Input macro */
+#define input() yyinput(yyscanner)
 
 
 
@@ -47,18 +121,667 @@ int yylineno; /* Input line number. */
 
 
 
+/******************************************************************************
+ * PARALLEL SCAN
+ *
+ * If YY_PARALLEL is defined, yy_init_parallel() makes a scanner that has
+ * the whole input in memory, and runs the DFA over it on several threads
+ * at once. The input is taken a round at a time; each thread scans a
+ * chunk of the round as if a token started where the chunk does, and
+ * records the steps it takes. yylex_r() then runs the actions in order,
+ * following the steps of one chunk until it reaches the next, where it
+ * goes on with the first step of that chunk that starts where it is.
+ * Until there is one (the chunk began in the middle of a token), it takes
+ * the steps itself. Since a step depends only on where it starts, the
+ * tokens are the ones a serial scan would find.
+ *
+ * The actions can't use yymore(), input(), unput() or yyless(), which
+ * work on the buffer of a serial scan. Link with -lpthread.
+ ******************************************************************************/
+#ifdef YY_PARALLEL
+
+#ifdef YY_DIRECT
+#error "YY_PARALLEL needs a transition table, which -g doesn't generate."
+#endif
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Characters each thread scans in a round. */
+#ifndef YY_PAR_ROUND
+#define YY_PAR_ROUND (1L << 20)
+#endif
+
+/* A token, a run of bad input, or the end of the scan. */
+struct yy_step {
+        long at;     /* Offset of the step in the input. */
+        long len;    /* Characters it takes. */
+        long line;   /* Newlines from the start of its chunk to its end. */
+        int accept;  /* Accepting state, 0 for bad input, -1 at the end. */
+        int anchor;  /* Anchor, as yylex_r() would see it. */
+};
+
+/* The part of a round that one thread scans. */
+struct yy_chunk {
+        struct yy_par *par;
+        long from;            /* The chunk is the input in [from, to). */
+        long to;
+        long nl;              /* Newlines in the chunk. */
+        long line0;           /* Newlines before the chunk. */
+        struct yy_step *step; /* Steps taken, in order. */
+        int nstep;
+        int max;
+};
+
+struct yy_par {
+        unsigned char *buf;     /* The input, after a newline. */
+        long size;              /* Size of @buf. */
+        unsigned char *map;     /* The mapping of @buf, if it is one. */
+        size_t maplen;
+        int nthreads;
+        struct yy_chunk *chunk; /* Chunks of the current round. */
+        long to;                /* End of the current round. */
+        int k;                  /* Chunk of the next step. */
+        int i;                  /* Where to look for it in the chunk. */
+        long at;                /* Offset of the next step. */
+        long line;              /* Newlines before it. */
+        unsigned char *text;    /* The lexeme, terminated. */
+        long textmax;
+};
+
+
 /**
- * input
- * `````
+ * yy_par_lines
+ * ````````````
+ * Count the newlines in [p, end).
+ */
+YYPRIVATE long yy_par_lines(const unsigned char *p, const unsigned char *end)
+{
+        long n = 0;
+
+        while (p < end && (p = memchr(p, '\n', end - p))) {
+                n++;
+                p++;
+        }
+        return n;
+}
+
+
+/**
+ * yy_par_step
+ * ```````````
+ * Take the step that yylex_r() would take from an offset of the input.
+ */
+YYPRIVATE void yy_par_step(struct yy_par *par, long at, struct yy_step *step)
+{
+        const unsigned char *p   = par->buf + at;
+        const unsigned char *end = par->buf + par->size;
+        const unsigned char *mark = p;
+        const unsigned char *q;
+        int yystate      = 0;
+        int yylastaccept = 0;
+        int yyanchor     = 0;
+        int yynstate;
+
+        for (q=p; q<end; q++) {
+                if ((yynstate = yy_next(yystate, *q)) == YYF)
+                        break;
+
+                if ((yyanchor = Yyaccept[yynstate])) {
+                        yylastaccept = yynstate;
+                        mark = q + 1;
+                }
+
+                yystate = yynstate;
+        }
+
+        step->at     = at;
+        step->accept = yylastaccept;
+        step->anchor = yyanchor;
+
+        if (yylastaccept) {
+                step->len = (mark - p) - ((yyanchor & 2) ? 1 : 0);
+        } else if (q == end) {
+                step->accept = -1;
+                step->len    = 0;
+        } else {
+                /* Bad input; skip it as yylex_r() does. */
+                q++;
+                #ifdef YY_FIRST
+                while (q < end && !(Yy_first[*q / 8] & (1 << (*q % 8))))
+                        q++;
+                #endif
+                step->len = q - p;
+        }
+}
+
+
+/**
+ * yy_par_scan
+ * ```````````
+ * Record the steps through a chunk, starting at its first character.
+ */
+YYPRIVATE void *yy_par_scan(void *arg)
+{
+        struct yy_chunk *c = arg;
+        struct yy_par *par = c->par;
+        struct yy_step *step;
+        long at   = c->from;
+        long line = 0;
+
+        c->nl    = yy_par_lines(par->buf + c->from, par->buf + c->to);
+        c->nstep = 0;
+
+        while (at < c->to) {
+                if (c->nstep == c->max) {
+                        c->max = (c->max) ? c->max * 2 : 1024;
+
+                        if (!(c->step = realloc(c->step, c->max * sizeof(struct yy_step)))) {
+                                YY_FATAL("Out of memory.\n");
+                        }
+                }
+
+                step = &c->step[c->nstep++];
+                yy_par_step(par, at, step);
+
+                if (step->accept < 0)
+                        break;
+
+                line      += yy_par_lines(par->buf + at, par->buf + at + step->len);
+                step->line = line;
+                at        += step->len;
+        }
+        return NULL;
+}
+
+
+/**
+ * yy_par_round
+ * ````````````
+ * Scan the chunks of the next round of input, one per thread.
+ */
+YYPRIVATE void yy_par_round(struct yy_par *par)
+{
+        pthread_t thread[par->nthreads];
+        long len;
+        int k;
+
+        len = (par->size - par->at + par->nthreads - 1) / par->nthreads;
+
+        if (len > YY_PAR_ROUND)
+                len = YY_PAR_ROUND;
+
+        for (k=0; k<par->nthreads; k++) {
+                par->chunk[k].from = par->at + k * len;
+                par->chunk[k].to   = par->at + (k + 1) * len;
+
+                if (par->chunk[k].from > par->size)
+                        par->chunk[k].from = par->size;
+                if (par->chunk[k].to > par->size)
+                        par->chunk[k].to = par->size;
+
+                if (k > 0 && pthread_create(&thread[k], NULL, yy_par_scan, &par->chunk[k]) != 0) {
+                        YY_FATAL("Can't create a thread.\n");
+                }
+        }
+
+        yy_par_scan(&par->chunk[0]);
+
+        for (k=1; k<par->nthreads; k++)
+                pthread_join(thread[k], NULL);
+
+        par->chunk[0].line0 = par->line;
+
+        for (k=1; k<par->nthreads; k++)
+                par->chunk[k].line0 = par->chunk[k-1].line0 + par->chunk[k-1].nl;
+
+        par->to = par->chunk[par->nthreads - 1].to;
+        par->k  = 0;
+        par->i  = 0;
+}
+
+
+/**
+ * yy_par_next
+ * ```````````
+ * Find the next token of a parallel scan.
+ *
+ * @yyscanner: The scanner.
+ * Return    : The accepting state of the token, whose lexeme is then in
+ *             yytext, or -1 at the end of the input.
+ */
+YYPRIVATE int yy_par_next(yyscan_t yyscanner)
+{
+        struct yy_par *par = yyscanner->par;
+        struct yy_chunk *c;
+        struct yy_step *step;
+        struct yy_step own;
+        long line;
+        long skip;
+
+        while (1) {
+                if (par->at >= par->size)
+                        return -1;
+
+                if (par->at >= par->to)
+                        yy_par_round(par);
+
+                c = &par->chunk[par->k];
+
+                if (par->at >= c->to) {
+                        par->k++;
+                        par->i = 0;
+                        continue;
+                }
+
+                while (par->i < c->nstep && c->step[par->i].at < par->at)
+                        par->i++;
+
+                if (par->i < c->nstep && c->step[par->i].at == par->at) {
+                        step = &c->step[par->i++];
+                        line = c->line0 + step->line;
+                } else {
+                        /* The thread started inside a token; catch up. */
+                        step = &own;
+                        yy_par_step(par, par->at, step);
+                        line = par->line + yy_par_lines(par->buf + step->at,
+                                                        par->buf + step->at + step->len);
+                }
+
+                if (step->accept < 0) {
+                        par->at = par->size;
+                        return -1;
+                }
+
+                par->at  += step->len;
+                par->line = line;
+
+                if (step->accept == 0) {
+                        #ifdef YYBADINP
+                                YY_ERROR("Ignoring bad input\n");
+                        #endif
+                        YY_BAD(step->len);
+                        continue;
+                }
+
+                skip = ((step->anchor & 1) && step->len > 0) ? 1 : 0;
+
+                if (step->len + 1 > par->textmax) {
+                        par->textmax = (step->len + 1) * 2;
+
+                        if (!(par->text = realloc(par->text, par->textmax))) {
+                                YY_FATAL("Out of memory.\n");
+                        }
+                }
+
+                memcpy(par->text, par->buf + step->at + skip, step->len - skip);
+                par->text[step->len - skip] = '\0';
+
+                yytext   = par->text;
+                yylen    = step->len - skip;
+                yylineno = line;
+
+                return step->accept;
+        }
+}
+
+
+/**
+ * yy_par_load
+ * ```````````
+ * Put the whole of an input file in memory, after a newline, as the
+ * serial scan sees it.
+ *
+ * NOTES
+ * A regular file is mapped by io_map_after_newline(), so that it isn't
+ * copied. Anything else is read.
+ */
+YYPRIVATE int yy_par_load(struct yy_par *par, int fd)
+{
+        long max;
+        long got;
+
+        if ((par->buf = io_map_after_newline(fd, &par->map, &par->maplen))) {
+                par->size = par->map + par->maplen - par->buf;
+        } else {
+                max       = 1 << 16;
+                par->size = 1;
+
+                if (!(par->buf = malloc(max))) {
+                        YY_FATAL("Out of memory.\n");
+                }
+
+                /* A read may be cut short, or interrupted; go on until EOF. */
+                while (1) {
+                        do {
+                                got = read(fd, par->buf + par->size, max - par->size);
+                        } while (got == -1 && errno == EINTR);
+
+                        if (got <= 0)
+                                break;
+
+                        if ((par->size += got) == max) {
+                                if (!(par->buf = realloc(par->buf, max *= 2))) {
+                                        YY_FATAL("Out of memory.\n");
+                                }
+                        }
+                }
+
+                if (got < 0) {
+                        free(par->buf);
+                        return -1;
+                }
+        }
+
+        par->buf[0] = '\n';
+
+        return 0;
+}
+
+
+/**
+ * yy_par_del
+ * ``````````
+ * Free the state of a parallel scan.
+ */
+YYPRIVATE void yy_par_del(struct yy_par *par)
+{
+        int k;
+
+        for (k=0; k<par->nthreads; k++)
+                free(par->chunk[k].step);
+
+        if (par->map)
+                munmap(par->map, par->maplen);
+        else
+                free(par->buf);
+
+        free(par->chunk);
+        free(par->text);
+        free(par);
+}
+#endif
+
+
+
+/******************************************************************************
+ * PUSH SCAN
+ *
+ * If YY_PUSH is defined, yy_init_push() makes a scanner that is handed
+ * its input a chunk at a time by yy_push(), rather than reading it, so
+ * that it never waits on a read. Each call runs the actions of the
+ * tokens that end in the chunk, and keeps the DFA state and the part of
+ * the token that runs on past the end of it for the next call, so that
+ * no character is run through the DFA twice except to back up to the
+ * last accepting state, as the serial scan does.
+ *
+ * A lexeme that lies within one chunk is taken from the chunk itself,
+ * and one that spans chunks from a copy of its part of them; yytext
+ * isn't terminated either way. The actions can't use yymore(), input(),
+ * unput() or yyless().
+ ******************************************************************************/
+#ifdef YY_PUSH
+
+#ifdef YY_DIRECT
+#error "YY_PUSH needs a transition table, which -g doesn't generate."
+#endif
+
+#ifdef YY_PARALLEL
+#error "YY_PUSH and YY_PARALLEL are different ways to scan."
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+void yylex_r(yyscan_t yyscanner);
+
+/*
+ * The input of the current token is @buf followed by @chunk; the token
+ * always starts at the start of @buf.
+ */
+struct yy_push {
+        unsigned char *buf;         /* The token so far, from earlier chunks. */
+        long n;                     /* Characters in @buf. */
+        long max;                   /* Allocated size of @buf. */
+        const unsigned char *chunk; /* What's left of the chunk being pushed. */
+        long len;                   /* Characters in @chunk. */
+        bool last;                  /* @chunk is the end of the input. */
+        bool done;                  /* The input is over. */
+        long taken;                 /* Characters of the last token. */
+        long scan;                  /* Characters the DFA has taken. */
+        long acc;                   /* Characters up to the last accepting state. */
+        int state;                  /* DFA state after @scan characters. */
+        int accept;                 /* Last accepting state, or 0. */
+        int anchor;                 /* Its anchor. */
+        long line;                  /* Newlines before the token. */
+};
+
+#define YY_PUSH_AT(ps, i) ((i) < (ps)->n ? (ps)->buf[i] : (ps)->chunk[(i) - (ps)->n])
+
+
+/**
+ * yy_push_keep
+ * ````````````
+ * Move the first @k characters of the chunk to the end of the buffer.
+ */
+YYPRIVATE void yy_push_keep(struct yy_push *ps, long k)
+{
+        if (k == 0)
+                return;
+
+        if (ps->n + k > ps->max) {
+                ps->max = (ps->n + k) * 2;
+
+                if (!(ps->buf = realloc(ps->buf, ps->max))) {
+                        YY_FATAL("Out of memory.\n");
+                }
+        }
+
+        memcpy(ps->buf + ps->n, ps->chunk, k);
+
+        ps->n     += k;
+        ps->chunk += k;
+        ps->len   -= k;
+}
+
+
+/**
+ * yy_push_drop
+ * ````````````
+ * Move the start of the token past its first @k characters, and start
+ * the DFA over from there.
+ */
+YYPRIVATE void yy_push_drop(struct yy_push *ps, long k)
+{
+        if (k < ps->n) {
+                memmove(ps->buf, ps->buf + k, ps->n - k);
+                ps->n -= k;
+        } else {
+                ps->chunk += k - ps->n;
+                ps->len   -= k - ps->n;
+                ps->n      = 0;
+        }
+
+        ps->scan   = 0;
+        ps->acc    = 0;
+        ps->state  = 0;
+        ps->accept = 0;
+}
+
+
+/**
+ * yy_push_next
+ * ````````````
+ * Find the next token of a push scan.
+ *
+ * @yyscanner: The scanner.
+ * Return    : The accepting state of the token, whose lexeme is then in
+ *             yytext, or -1 if the chunk has run out or the input is over.
+ */
+YYPRIVATE int yy_push_next(yyscan_t yyscanner)
+{
+        struct yy_push *ps = yyscanner->push;
+        unsigned char *text;
+        long total;
+        long skip;
+        long len;
+        long i;
+        int next;
+
+        if (ps->taken) {
+                yy_push_drop(ps, ps->taken);
+                ps->taken = 0;
+        }
+
+        while (!ps->done) {
+                total = ps->n + ps->len;
+
+                for (next=0; ps->scan < total; ps->scan++) {
+                        if ((next = yy_next(ps->state, YY_PUSH_AT(ps, ps->scan))) == YYF)
+                                break;
+
+                        if (Yyaccept[next]) {
+                                ps->accept = next;
+                                ps->anchor = Yyaccept[next];
+                                ps->acc    = ps->scan + 1;
+                        }
+
+                        ps->state = next;
+                }
+
+                /* The token may go on in the next chunk. */
+                if (ps->scan == total && !ps->last) {
+                        yy_push_keep(ps, ps->len);
+                        return -1;
+                }
+
+                if (!ps->accept) {
+                        /* At the end, what's left is no token. */
+                        if (ps->scan == total) {
+                                ps->done = true;
+                                break;
+                        }
+
+                        #ifdef YYBADINP
+                                YY_ERROR("Ignoring bad input\n");
+                        #endif
+
+                        /* Skip bad input as yylex_r() does. */
+                        skip = ps->scan + 1;
+
+                        #ifdef YY_FIRST
+                        while (skip < total && !(Yy_first[YY_PUSH_AT(ps, skip) / 8] & (1 << (YY_PUSH_AT(ps, skip) % 8))))
+                                skip++;
+                        #endif
+
+                        YY_BAD(skip);
+
+                        for (i=0; i<skip; i++) {
+                                if (YY_PUSH_AT(ps, i) == '\n')
+                                        ps->line++;
+                        }
+
+                        yy_push_drop(ps, skip);
+                        continue;
+                }
+
+                len = ps->acc - ((ps->anchor & 2) ? 1 : 0);
+
+                /* Put a lexeme that spans chunks together. */
+                if (ps->n > 0 && len > ps->n)
+                        yy_push_keep(ps, len - ps->n);
+
+                text = (ps->n > 0) ? ps->buf : (unsigned char *)ps->chunk;
+
+                for (i=0; i<len; i++) {
+                        if (text[i] == '\n')
+                                ps->line++;
+                }
+
+                skip = ((ps->anchor & 1) && len > 0) ? 1 : 0;
+
+                yytext    = text + skip;
+                yylen     = len - skip;
+                yylineno  = ps->line;
+                ps->taken = len;
+
+                return ps->accept;
+        }
+
+        yytext = (unsigned char *)"";
+        yylen  = 0;
+
+        return -1;
+}
+
+
+/**
+ * yy_init_push
+ * ````````````
+ * Create a scanner that is given its input by yy_push().
+ */
+void yy_init_push(yyscan_t *yyscanner)
+{
+        yyscan_t new;
+
+        if (!(new = calloc(1, sizeof(struct yy_scan)))
+        ||  !(new->push = calloc(1, sizeof(struct yy_push)))) {
+                YY_FATAL("Out of memory.\n");
+        }
+
+        /* The newline the serial scan puts in front of the input. */
+        new->push->chunk = (const unsigned char *)"\n";
+        new->push->len   = 1;
+        yy_push_keep(new->push, 1);
+
+        /* The actions may still call on the buffer, which is empty. */
+        new->io    = io_new();
+        new->begun = true;
+
+        *yyscanner = new;
+}
+
+
+/**
+ * yy_push
+ * ```````
+ * Scan the next chunk of the input of a push scanner.
+ *
+ * @yyscanner: The scanner.
+ * @chunk    : The chunk, which is no longer needed when this returns.
+ * @len      : Length of @chunk.
+ * @last     : The chunk is the end of the input (it may be empty).
+ *
+ * NOTES
+ * The actions are run for the tokens that end in the chunk. Those of
+ * the token at the end of it run on the next call, since it may go on.
+ */
+void yy_push(yyscan_t yyscanner, const void *chunk, size_t len, bool last)
+{
+        yyscanner->push->chunk = chunk;
+        yyscanner->push->len   = len;
+        yyscanner->push->last  = last;
+
+        yylex_r(yyscanner);
+}
+#endif
+
+
+/**
+ * yyinput
+ * ```````
  * The most basic input function.
  */
-int input(void)
+int yyinput(yyscan_t yyscanner)
 {
         int c;
 
-        if ((c = io_input())) {
-                yytext   = io_text();
-                yylineno = io_lineno();
+        if ((c = io_input_r(yyscanner->io))) {
+                yytext   = io_text_r(yyscanner->io);
+                yylineno = io_lineno_r(yyscanner->io);
                 ++yylen;
         }
         return c;
@@ -66,37 +789,231 @@ int input(void)
 
 
 /**
- * yylex
- * `````
- * Lex the input file.
+ * yy_init
+ * ```````
+ * Create a scanner with an input buffer of its own.
+ *
+ * @yyscanner: Set to the new scanner.
+ * @name     : Path to the input file, or NULL for stdin.
+ * Return    : The file descriptor of the input, or -1 if the file can't
+ *             be opened (and then there is no new scanner).
  */
-void yylex(void)
+int yy_init(yyscan_t *yyscanner, char *name)
 {
-        static int yystate = -1; // Current state
+        yyscan_t new;
+        int fd;
+
+        if (!(new = calloc(1, sizeof(struct yy_scan)))) {
+                YY_FATAL("Out of memory.\n");
+        }
+
+        new->io = io_new();
+        yy_bufsize_r(new->io);
+
+        if ((fd = yy_open_r(new->io, name)) == -1) {
+                io_del(new->io);
+                free(new);
+                return -1;
+        }
+
+        *yyscanner = new;
+
+        return fd;
+}
+
+
+/**
+ * yy_init_buffer
+ * ``````````````
+ * Create a scanner that reads a buffer in memory (see io_newbuffer()).
+ *
+ * @yyscanner: Set to the new scanner.
+ * @buf      : The input, which has to stay put until the scanner is
+ *             destroyed.
+ * @len      : Length of @buf.
+ */
+void yy_init_buffer(yyscan_t *yyscanner, const void *buf, size_t len)
+{
+        yyscan_t new;
+
+        if (!(new = calloc(1, sizeof(struct yy_scan)))) {
+                YY_FATAL("Out of memory.\n");
+        }
+
+        new->io = io_new();
+        io_newbuffer_r(new->io, buf, len);
+
+        *yyscanner = new;
+}
+
+
+#ifdef YY_PARALLEL
+/**
+ * yy_init_parallel
+ * ````````````````
+ * Create a scanner that scans its input on several threads.
+ *
+ * @yyscanner: Set to the new scanner.
+ * @name     : Path to the input file, or NULL for stdin.
+ * @nthreads : Number of threads, or 0 for one per processor.
+ * Return    : 0, or -1 if the input can't be read (and then there is
+ *             no new scanner).
+ *
+ * NOTES
+ * The input is read or mapped whole before this returns.
+ */
+int yy_init_parallel(yyscan_t *yyscanner, char *name, int nthreads)
+{
+        yyscan_t new;
+        int fd;
+        int k;
+
+        if ((fd = (name) ? open(name, O_RDONLY) : 0) == -1)
+                return -1;
+
+        if (!(new = calloc(1, sizeof(struct yy_scan)))
+        ||  !(new->par = calloc(1, sizeof(struct yy_par)))) {
+                YY_FATAL("Out of memory.\n");
+        }
+
+        if (yy_par_load(new->par, fd) == -1) {
+                if (name)
+                        close(fd);
+                free(new->par);
+                free(new);
+                return -1;
+        }
+
+        if (name)
+                close(fd);
+
+        if (nthreads <= 0)
+                nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0)
+                nthreads = 1;
+
+        if (!(new->par->chunk = calloc(nthreads, sizeof(struct yy_chunk)))) {
+                YY_FATAL("Out of memory.\n");
+        }
+
+        for (k=0; k<nthreads; k++)
+                new->par->chunk[k].par = new->par;
+
+        new->par->nthreads = nthreads;
+
+        /* The actions may still call on the buffer, which is empty. */
+        new->io    = io_new();
+        new->begun = true;
+
+        *yyscanner = new;
+
+        return 0;
+}
+#endif
+
+
+/**
+ * yy_destroy
+ * ``````````
+ * Free a scanner made by yy_init(), closing its input file.
+ */
+void yy_destroy(yyscan_t yyscanner)
+{
+        #ifdef YY_PARALLEL
+        if (yyscanner->par)
+                yy_par_del(yyscanner->par);
+        #endif
+
+        #ifdef YY_PUSH
+        if (yyscanner->push) {
+                free(yyscanner->push->buf);
+                free(yyscanner->push);
+        }
+        #endif
+
+        io_del(yyscanner->io);
+        free(yyscanner);
+}
+
+
+/**
+ * yylex_r
+ * ```````
+ * Lex the input file of a scanner.
+ */
+void yylex_r(yyscan_t yyscanner)
+{
+        struct io_t *yyio;       // Input of the scanner
+        int yystate;             // Current state
         int yymoreflg;           // Set when yymore() is executed
         int yylastaccept;        // Most recently seen accept state
         int yyprev;              // State before yylastaccept
+        #ifndef YY_DIRECT
         int yynstate;            // Next state, given lookahead
         int yylook;              // Lookahead character
+        #endif
         int yyanchor;            // Anchor point for last seen accepting state.
 
         /* Initialization */
-        if (yystate == -1) {
-                io_advance();
-                io_pushback(1);
-                yyanchor = 0;
+        yyio     = yyscanner->io;
+        yyanchor = 0;
+
+        if (!yyscanner->begun) {
+                io_advance_r(yyio);
+                io_pushback_r(yyio, 1);
+                yyscanner->begun = true;
         }
 
         /* Top of loop initialization */
         yystate      = 0;
         yylastaccept = 0;
         yymoreflg    = 0;
-        io_unterm();
-        io_mark_start();
+        io_unterm_r(yyio);
+        io_mark_start_r(yyio);
 
         while (1) {
+                #ifdef YY_PARALLEL
+                /* The threads have found the tokens already. */
+                if (yyscanner->par) {
+                        if ((yylastaccept = yy_par_next(yyscanner)) < 0) {
+                                yytext = (unsigned char *)"";
+                                yylen  = 0;
+                                return;
+                        }
+                        goto yyaction;
+                }
+                #endif
+
+                #ifdef YY_PUSH
+                /* The tokens come from the chunks pushed. */
+                if (yyscanner->push) {
+                        if ((yylastaccept = yy_push_next(yyscanner)) < 0)
+                                return;
+                        goto yyaction;
+                }
+                #endif
+
+                #ifdef YY_DIRECT
+                /* Run the coded states until they get stuck. */
+                if ((yylastaccept = yy_run(yyio, yystate, &yyprev, &yyanchor)) < 0) {
+                        yytext = (unsigned char *)"";
+                        yylen  = 0;
+                        return;
+                }
+                #else
+                #ifdef YY_SKIP
+                /* Run through the characters the state loops on. */
+                if (Yy_skip[yystate]
+                &&  io_skip_r(yyio, Yy_esc[Yy_skip[yystate]].c, Yy_esc[Yy_skip[yystate]].n) > 0
+                &&  (yyanchor = Yyaccept[yystate])) {
+                        yyprev       = yystate;
+                        yylastaccept = yystate;
+                        io_mark_end_r(yyio);
+                }
+                #endif
+
                 while (1) {
-                        if ((yylook=io_look(1)) != EOF) {
+                        if ((yylook=io_look_r(yyio, 1)) != EOF) {
                                 yynstate = yy_next(yystate, yylook);
                                 break;
                         } else {
@@ -108,83 +1025,322 @@ void yylex(void)
                                         yylen  = 0;
                                         return;
                                 } else {
-                                        io_advance();
-                                        io_pushback(1);
+                                        io_advance_r(yyio);
+                                        io_pushback_r(yyio, 1);
                                 }
                         }
                 }
 
                 if (yynstate != YYF) {
 
-                        if (io_advance() < 0) {
-                                YY_ERROR("Lexeme too long, truncating.\n");
-                                io_flush(true);
-                        }
+                        io_advance_r(yyio);
 
                         /* Saw an accept state. */
                         if ((yyanchor = Yyaccept[yynstate])) {
                                 yyprev = yystate;
                                 yylastaccept = yynstate;
-                                io_mark_end();
+                                io_mark_end_r(yyio);
                         }
 
                         yystate = yynstate;
+                        continue;
+                }
+                #endif
+
+                /* Skip bad input. */
+                if (!yylastaccept) {
+                        #ifdef YYBADINP
+                                YY_ERROR("Ignoring bad input\n");
+                        #endif
+                        io_advance_r(yyio);
+                        YY_BAD(1);
+
+                        #ifdef YY_FIRST
+                        /* No rule can start before the next of these. */
+                        YY_BAD(io_skipset_r(yyio, Yy_first));
+                        #endif
                 } else {
-                        /* Skip bad input. */
-                        if (!yylastaccept) {
-                                #ifdef YYBADINP
-                                        YY_ERROR("Ignoring bad input\n");
-                                #endif
-                                io_advance();
-                        } else {
-                                io_to_mark();
+                        io_to_mark_r(yyio);
 
-                                if ((yyanchor & 2)) {
-                                        io_pushback(1);
-                                }
+                        if ((yyanchor & 2)) {
+                                io_pushback_r(yyio, 1);
+                        }
 
-                                if ((yyanchor & 1)) {
-                                        io_move_start();
-                                }
+                        if ((yyanchor & 1)) {
+                                io_move_start_r(yyio);
+                        }
 
-                                io_term();
-                                yylen = io_length();
-                                yytext = io_text();
-                                yylineno = io_lineno();
+                        io_term_r(yyio);
+                        yylen = io_length_r(yyio);
+                        yytext = io_text_r(yyio);
+                        yylineno = io_lineno_r(yyio);
 
-                                switch (yylastaccept) {
+                        #if defined(YY_PARALLEL) || defined(YY_PUSH)
+                        yyaction:
+                        #endif
+                        switch (yylastaccept) {
 
-                                /* ---- CASE STATEMENTS INSERTED HERE ---- */
+                        /* ---- CASE STATEMENTS INSERTED HERE ---- */
 
-                                        default:
-                                                YY_FATAL("ERROR, yylex\n");
-                                                break;
-                                }
+                                default:
+                                        YY_FATAL("ERROR, yylex\n");
+                                        break;
                         }
+                }
 
-                        io_unterm();
-                        yylastaccept = 0;
+                io_unterm_r(yyio);
+                yylastaccept = 0;
 
-                        if (!yymoreflg) {
-                                yystate = 0;
-                                io_mark_start();
-                        } else {
-                                yystate = yyprev;
-                                yymoreflg = 0;
+                if (!yymoreflg) {
+                        yystate = 0;
+                        io_mark_start_r(yyio);
+                } else {
+                        yystate = yyprev;
+                        yymoreflg = 0;
+                }
+        }
+}
+
+
+/**
+ * yylex
+ * `````
+ * Lex the input file, as given to io_newfile().
+ */
+void yylex(void)
+{
+        if (!yy_std.io)
+                yy_std.io = io_std();
+
+        yylex_r(&yy_std);
+}
+
+
+#ifdef YY_BATCH
+/******************************************************************************
+ * BATCH SCAN
+ *
+ * A scanner generated with -b has no actions. yylex_batch() fills an
+ * array with the tokens it finds instead, and the caller goes through
+ * them at its own pace, so that the call and the dispatch are paid once
+ * for many tokens. The lexeme of a token stays in the buffer until the
+ * next call (the first token of a batch is held with io_mark_prev()), and
+ * a batch ends when the buffer has been refilled, so that it doesn't have
+ * to grow for more than one batch.
+ *
+ * yymore(), input(), unput() and yyless() have no place in it, and it
+ * doesn't terminate the lexemes.
+ ******************************************************************************/
+
+#ifdef YY_PARALLEL
+#error "YY_BATCH doesn't run the parallel scan."
+#endif
+
+/* A token found by yylex_batch(). */
+struct yy_token {
+        long at;   /* Offset of the lexeme in the input. */
+        int len;   /* Length of the lexeme. */
+        int rule;  /* Rule that matched, counting from 1. */
+        int line;  /* Input line number, as yylineno would be. */
+};
+
+
+/**
+ * yylex_batch
+ * ```````````
+ * Find the next tokens of a scanner.
+ *
+ * @yyscanner: The scanner.
+ * @tok      : Filled with the tokens, in order.
+ * @n        : Most tokens to find.
+ * Return    : The number of tokens found, 0 at the end of the input.
+ *
+ * NOTES
+ * Fewer than @n tokens are found when the buffer is refilled during the
+ * batch. Bad input is skipped, as yylex_r() skips it.
+ */
+int yylex_batch(yyscan_t yyscanner, struct yy_token *tok, int n)
+{
+        struct io_t *yyio;       // Input of the scanner
+        uintptr_t yybase;        // Where the buffer puts offset 0
+        int yystate;             // Current state
+        int yylastaccept;        // Most recently seen accept state
+        #ifdef YY_DIRECT
+        int yyprev;              // State before yylastaccept
+        #else
+        int yynstate;            // Next state, given lookahead
+        int yylook;              // Lookahead character
+        #endif
+        int yyanchor;            // Anchor point for last seen accepting state.
+        int k = 0;
+
+        yyio = yyscanner->io;
+
+        if (!yyscanner->begun) {
+                io_advance_r(yyio);
+                io_pushback_r(yyio, 1);
+                yyscanner->begun = true;
+        }
+
+        io_mark_start_r(yyio);
+        io_mark_prev_r(yyio);
+
+        yybase = (uintptr_t)io_text_r(yyio) - io_offset_r(yyio);
+
+        while (k < n) {
+                yystate      = 0;
+                yylastaccept = 0;
+                yyanchor     = 0;
+
+                #ifdef YY_DIRECT
+                if ((yylastaccept = yy_run(yyio, yystate, &yyprev, &yyanchor)) < 0)
+                        break;
+                #else
+                while (1) {
+                        #ifdef YY_SKIP
+                        /* Run through the characters the state loops on. */
+                        if (Yy_skip[yystate]
+                        &&  io_skip_r(yyio, Yy_esc[Yy_skip[yystate]].c, Yy_esc[Yy_skip[yystate]].n) > 0
+                        &&  (yyanchor = Yyaccept[yystate])) {
+                                yylastaccept = yystate;
+                                io_mark_end_r(yyio);
+                        }
+                        #endif
+
+                        if ((yylook=io_look_r(yyio, 1)) == EOF
+                        ||  (yynstate = yy_next(yystate, yylook)) == YYF)
+                                break;
+
+                        io_advance_r(yyio);
+
+                        if ((yyanchor = Yyaccept[yynstate])) {
+                                yylastaccept = yynstate;
+                                io_mark_end_r(yyio);
+                        }
+
+                        yystate = yynstate;
+                }
+
+                if (yylook == EOF && !yylastaccept)
+                        break;
+                #endif
+
+                if (!yylastaccept) {
+                        #ifdef YYBADINP
+                                YY_ERROR("Ignoring bad input\n");
+                        #endif
+                        io_advance_r(yyio);
+                        YY_BAD(1);
+
+                        #ifdef YY_FIRST
+                        YY_BAD(io_skipset_r(yyio, Yy_first));
+                        #endif
+                } else {
+                        io_to_mark_r(yyio);
+
+                        if ((yyanchor & 2)) {
+                                io_pushback_r(yyio, 1);
+                        }
+
+                        if ((yyanchor & 1)) {
+                                io_move_start_r(yyio);
+                        }
+
+                        tok[k].at   = io_offset_r(yyio);
+                        tok[k].len  = io_length_r(yyio);
+                        tok[k].rule = Yy_rule[yylastaccept];
+                        tok[k].line = io_lineno_r(yyio);
+
+                        #ifdef YY_KEYWORDS
+                        if (tok[k].rule < 0) {
+                                if (!(tok[k].rule = yy_keyword(io_text_r(yyio), tok[k].len)))
+                                        tok[k].rule = -Yy_rule[yylastaccept];
                         }
+                        #endif
+                        k++;
                 }
+
+                io_mark_start_r(yyio);
+
+                /* The buffer was refilled. */
+                if (k > 0 && (uintptr_t)io_text_r(yyio) - io_offset_r(yyio) != yybase)
+                        break;
         }
+
+        return k;
 }
 
 
+/**
+ * yy_batch_text
+ * `````````````
+ * The lexeme of a token of the last batch. It isn't terminated.
+ */
+unsigned char *yy_batch_text(yyscan_t yyscanner, struct yy_token *tok)
+{
+        return io_text_r(yyscanner->io) - (io_offset_r(yyscanner->io) - tok->at);
+}
+#endif
+
+
 int main(int argc, char *argv[])
 {
+        #ifdef YY_PARALLEL
+        yyscan_t yyscanner;
+
+        if (yy_init_parallel(&yyscanner, (argc == 2) ? argv[1] : NULL, 0) == -1) {
+                YY_FATAL("Can't read the input.\n");
+        }
+
+        yylex_r(yyscanner);
+        yy_destroy(yyscanner);
+        #elif defined(YY_BATCH)
+        struct yy_token tok[256];
+        yyscan_t yyscanner;
+        int n;
+        int i;
+
+        if (yy_init(&yyscanner, (argc == 2) ? argv[1] : NULL) == -1) {
+                YY_FATAL("Can't open the input.\n");
+        }
+
+        /* Print the tokens, one per line. */
+        while ((n = yylex_batch(yyscanner, tok, 256)) > 0) {
+                for (i=0; i<n; i++) {
+                        fprintf(yyout, "%d\t%d\t%ld\t", tok[i].line, tok[i].rule, tok[i].at);
+                        fwrite(yy_batch_text(yyscanner, &tok[i]), 1, tok[i].len, yyout);
+                        fputc('\n', yyout);
+                }
+        }
+
+        yy_destroy(yyscanner);
+        #elif defined(YY_PUSH)
+        unsigned char chunk[4096];
+        yyscan_t yyscanner;
+        ssize_t got;
+        int fd;
+
+        if ((fd = (argc == 2) ? open(argv[1], O_RDONLY) : 0) == -1) {
+                YY_FATAL("Can't open the input.\n");
+        }
+
+        yy_init_push(&yyscanner);
+
+        while ((got = read(fd, chunk, sizeof(chunk))) > 0)
+                yy_push(yyscanner, chunk, got, false);
+
+        yy_push(yyscanner, NULL, 0, true);
+        yy_destroy(yyscanner);
+        #else
+        yy_bufsize_r(io_std());
+
         if (argc == 2)
-                io_newfile(argv[1]);
+                yy_open_r(io_std(), argv[1]);
         else
-                io_newfile(NULL); // Defaults to stdin
+                yy_open_r(io_std(), NULL); // Defaults to stdin
 
         yylex();
+        #endif
 
         return 1;
 }
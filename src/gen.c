@@ -1,8 +1,13 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "lib/textutils.h"
+#include "lib/debug.h"
 #include "nfa.h"
 #include "dfa.h"
+#include "keyword.h"
+#include "input.h"
 #include "main.h"
 #include "gen.h"
 
@@ -13,6 +18,8 @@
  */
 
 
+#define NCOLS 10 // Num. columns used to print arrays
+
 enum driver_mode { DRIVER_HEADER, DRIVER_TOP, DRIVER_BOTTOM };
 
 /**
@@ -55,9 +62,11 @@ void driver(FILE *output, enum driver_mode mode)
  * @out: output stream
  * @dtran: DFA transition table
  * @nrows: Number of states in dtran[]
+ * @ncols: Number of columns in dtran[]
+ * @ec: character class of each character (the columns of dtran[])
  * @accept: set of accept states in dtran[]
  */
-void pheader(FILE *out, int **dtran, int nrows, struct accept_t *accept)
+void pheader(FILE *out, int *dtran, int nrows, int ncols, int *ec, struct accept_t *accept)
 {
         int last_transition;
         int chars_printed = 0;
@@ -88,9 +97,9 @@ void pheader(FILE *out, int **dtran, int nrows, struct accept_t *accept)
 	        last_transition = -1;
 
 	        for (j=0; j<MAX_CHARS; j++) {
-	                if (dtran[i][j] != F) {
-		                if (dtran[i][j] != last_transition) {
-		                        fprintf(out, "\n *    goto %2d on ", dtran[i][j]);
+	                if (dtran[i*ncols + ec[j]] != F) {
+		                if (dtran[i*ncols + ec[j]] != last_transition) {
+		                        fprintf(out, "\n *    goto %2d on ", dtran[i*ncols + ec[j]]);
 		                        chars_printed = 0;
 		                }
 		                fprintf(out, "%s", bin_to_ascii(j,1) );
@@ -100,7 +109,7 @@ void pheader(FILE *out, int **dtran, int nrows, struct accept_t *accept)
 		                        chars_printed = 0;
 		                }
 
-		                last_transition = dtran[i][j];
+		                last_transition = dtran[i*ncols + ec[j]];
 	                }
 	        }
 	        fprintf(out, "\n");
@@ -111,16 +120,15 @@ void pheader(FILE *out, int **dtran, int nrows, struct accept_t *accept)
 
 
 /**
- * pdriver
- * ```````
- * Print the array of accepting states, the driver itself, and the case
- * statements for the accepting strings.
+ * print_accept
+ * ````````````
+ * Print the array of accepting states.
  *
  * @output: Output stream
  * @nrows: number of states in dtran[]
  * @accept: set of accepting states in dtran[]
  */
-void pdriver(FILE *output, int nrows, struct accept_t *accept)
+void print_accept(FILE *output, int nrows, struct accept_t *accept)
 {
         int i;
 
@@ -134,7 +142,7 @@ void pdriver(FILE *output, int nrows, struct accept_t *accept)
                 " *\t 3 = both\n"
                 " *\t 4 = neither\n"
                 " */\n"
-                "YYPRIVATE YY_TTYPE Yyaccept[] = \n");
+                "YYPRIVATE const YY_TTYPE Yyaccept[] = \n");
         fprintf(output, "{\n");
 
         /* Print the array of accepting states */
@@ -147,6 +155,22 @@ void pdriver(FILE *output, int nrows, struct accept_t *accept)
 	        fprintf(output, "%c  /* State %-3d */\n", i == (nrows -1) ? ' ' : ',' , i);
         }
         fprintf(output, "};\n\n");
+}
+
+
+/**
+ * pdriver
+ * ```````
+ * Print the driver itself, and the case statements for the accepting
+ * strings.
+ *
+ * @output: Output stream
+ * @nrows: number of states in dtran[]
+ * @accept: set of accepting states in dtran[]
+ */
+void pdriver(FILE *output, int nrows, struct accept_t *accept)
+{
+        int i;
 
         /* Print code above case statements */
         driver(output, DRIVER_TOP);	
@@ -172,13 +196,12 @@ void pdriver(FILE *output, int nrows, struct accept_t *accept)
  * to by "array." Prints only the initialization part of the declaration.
  *
  * @fp: output stream.
- * @array: DFA transition table
+ * @array: DFA transition table, stored row after row
  * @nrows: number of rows in array[]
  * @ncols: number of cols in array[]
  */
-void print_array(FILE *fp, int **array, int nrows, int ncols)
+void print_array(FILE *fp, int *array, int nrows, int ncols)
 {
-        #define NCOLS 10 // Num. columns used to print arrays
         int j;           // Output column.
         int i;
 
@@ -188,7 +211,7 @@ void print_array(FILE *fp, int **array, int nrows, int ncols)
 	        fprintf(fp, "/* %02d */  { ", i);
 
 	        for (j=0; j<ncols; j++) {
-	                fprintf(fp, "%3d" , array[i][j]);
+	                fprintf(fp, "%3d" , array[i*ncols + j]);
 	                if (j < ncols-1)
 		                fprintf(fp, ", ");
 
@@ -205,6 +228,129 @@ void print_array(FILE *fp, int **array, int nrows, int ncols)
 }
 
 
+/**
+ * uint_type
+ * `````````
+ * Return the name of the narrowest unsigned type that holds @max.
+ */
+static const char *uint_type(unsigned long max)
+{
+        if (max <= UINT8_MAX)
+                return "uint8_t";
+        else if (max <= UINT16_MAX)
+                return "uint16_t";
+        else
+                return "uint32_t";
+}
+
+
+/**
+ * print_ttype
+ * ```````````
+ * Print the definition of YY_TTYPE, the type of a table entry, as the
+ * narrowest unsigned type that can hold every state number plus YYF.
+ *
+ * @fp: output stream.
+ * @nstates: number of states in the DFA.
+ */
+void print_ttype(FILE *fp, int nstates)
+{
+        fprintf(fp, "/*\n"
+                    " * Table entries are state numbers. YYF, the failure\n"
+                    " * transition, is the largest value of the type.\n"
+                    " */\n"
+                    "typedef %s YY_TTYPE;\n"
+                    "#define YYF ((YY_TTYPE)(-1))\n\n", uint_type(nstates));
+}
+
+
+/**
+ * print_vector
+ * ````````````
+ * Print the C source code to initialize a one-dimensional array.
+ * Prints only the initialization part of the declaration.
+ *
+ * @fp: output stream.
+ * @vec: array to print
+ * @n: number of elements in vec[]
+ */
+void print_vector(FILE *fp, int *vec, int n)
+{
+        int i;
+
+        fprintf(fp, "{\n");
+
+        for (i=0; i<n; i++) {
+                if ((i % NCOLS) == 0)
+                        fprintf(fp, "/* %04d */  ", i);
+
+                fprintf(fp, "%5d%c", vec[i], i < n-1 ? ',' : ' ');
+
+                if ((i % NCOLS) == NCOLS-1 || i == n-1)
+                        fprintf(fp, "\n");
+        }
+        fprintf(fp, "};\n");
+}
+
+
+/**
+ * print_string
+ * ````````````
+ * Print a string as a C string literal.
+ *
+ * @fp   : output stream.
+ * @str  : string, not terminated.
+ * @len  : length of @str.
+ * Return: Nothing.
+ */
+static void print_string(FILE *fp, unsigned char *str, int len)
+{
+        int i;
+
+        putc('"', fp);
+
+        for (i=0; i<len; i++) {
+                if (str[i] == '"' || str[i] == '\\')
+                        fprintf(fp, "\\%c", str[i]);
+                else if (str[i] < ' ' || str[i] > '~')
+                        fprintf(fp, "\\%03o", str[i]);
+                else
+                        putc(str[i], fp);
+        }
+
+        putc('"', fp);
+}
+
+
+/**
+ * print_ec
+ * ````````
+ * Print the C source code to initialize the character class map.
+ * Prints only the initialization part of the declaration.
+ *
+ * @fp: output stream.
+ * @ec: character class of each character
+ * @nchars: number of characters in ec[]
+ */
+void print_ec(FILE *fp, int *ec, int nchars)
+{
+        int i;
+
+        fprintf(fp, "{\n");
+
+        for (i=0; i<nchars; i++) {
+                if ((i % 16) == 0)
+                        fprintf(fp, "/* %02x */  ", i);
+
+                fprintf(fp, "%3d%c", ec[i], i < nchars-1 ? ',' : ' ');
+
+                if ((i % 16) == 15 || i == nchars-1)
+                        fprintf(fp, "\n");
+        }
+        fprintf(fp, "};\n");
+}
+
+
 /**
  * defnext
  * ```````
@@ -212,14 +358,984 @@ void print_array(FILE *fp, int **array, int nrows, int ncols)
  *
  * @fp: output stream
  * @name: Definition name
+ * @ecname: Name of the character class map
+ */
+void defnext(FILE *fp, char *name, char *ecname)
+{
+        fprintf(fp, "/*\n"
+                    " * yy_next(state,c) is given the current state and input\n"
+                    " * character and evaluates to the next state. The table\n"
+                    " * has one column per character class.\n"
+                    " */\n"
+                    "#define yy_next(state, c) %s[state][%s[c]]\n", name, ecname);
+}
+
+
+
+/**
+ * print_ecmap
+ * ```````````
+ * Print the declaration of the character class map.
+ *
+ * @fp: output stream.
+ * @dfa: DFA object.
+ */
+void print_ecmap(FILE *fp, struct dfa_t *dfa)
+{
+        fprintf(fp,
+                "/*\n"
+                " * %s[c] is the column of character c in the transition\n"
+                " * table. Characters in the same class always go to the\n"
+                " * same state.\n"
+                " */\n"
+                "YYPRIVATE const unsigned char  %s[%d] =\n",
+                ECMAP_NAME, ECMAP_NAME, MAX_CHARS);
+
+        print_ec(fp, dfa->ec, MAX_CHARS);
+}
+
+
+/******************************************************************************
+ * COMB-VECTOR TABLES
+ *
+ * The rows of the transition table are overlaid on one another in a
+ * single vector, Yy_nxt[], so that the entries of one row fall into the
+ * holes left by the others. Each state gets a default transition, the
+ * most common entry of its row, and only the other entries are stored.
+ * Row s starts at Yy_base[s], and Yy_chk[] records which state owns each
+ * slot, so a lookup is:
+ *
+ *      i = Yy_base[s] + yy_ec[c];
+ *      next = (Yy_chk[i] == s) ? Yy_nxt[i] : Yy_def[s];
+ *
+ * This is the scheme of Tarjan and Yao, with defaults that are single
+ * states rather than chains of other rows, so a lookup never loops.
+ ******************************************************************************/
+
+/* Rows are packed in order of decreasing number of stored entries. */
+static int *sort_count;
+
+static int count_cmp(const void *a, const void *b)
+{
+        int x = *(const int *)a;
+        int y = *(const int *)b;
+
+        if (sort_count[x] != sort_count[y])
+                return sort_count[y] - sort_count[x];
+
+        return x - y;
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+        return *(const int *)a - *(const int *)b;
+}
+
+
+/**
+ * row_default
+ * ```````````
+ * Find the most common entry in a row of the transition table.
+ *
+ * @row  : The row.
+ * @ncols: Length of the row.
+ * @tmp  : Scratch space of @ncols ints.
+ * Return: The entry; the lowest one if several are equally common.
+ */
+static int row_default(int *row, int ncols, int *tmp)
+{
+        int best = F;
+        int most = 0;
+        int run;
+        int i;
+
+        memcpy(tmp, row, ncols * sizeof(int));
+        qsort(tmp, ncols, sizeof(int), int_cmp);
+
+        for (i=0; i<ncols; i+=run) {
+                for (run=1; i+run<ncols && tmp[i+run]==tmp[i]; run++)
+                        ;
+                if (run > most) {
+                        most = run;
+                        best = tmp[i];
+                }
+        }
+
+        return best;
+}
+
+
+/**
+ * print_comb
+ * ``````````
+ * Pack the transition table into comb vectors and print them, along
+ * with a yy_next() to read them.
+ *
+ * @fp   : output stream.
+ * @dfa  : DFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * Rows are placed first-fit, the fullest first, at the lowest base at
+ * which none of their stored entries collide with an occupied slot.
+ * The vectors are padded so that Yy_base[s] + ncols is always in range,
+ * and empty slots are owned by YYF, which is never a state.
+ */
+void print_comb(FILE *fp, struct dfa_t *dfa)
+{
+        int *base;   // Start of each row in the vectors.
+        int *def;    // Default transition of each state.
+        int *count;  // Number of stored (non-default) entries of each row.
+        int *order;  // Rows in packing order.
+        int *nxt;    // Packed entries.
+        int *chk;    // Owner of each slot, or F if empty.
+        int *tmp;
+        int *row;
+        int size;    // Length of the vectors in use.
+        int max;     // Allocated length of the vectors.
+        int lo;      // No slot below this is empty.
+        int dense;
+        int comb;
+        int b, s, c, i;
+
+        base  = malloc(dfa->n * sizeof(int));
+        def   = malloc(dfa->n * sizeof(int));
+        count = calloc(dfa->n, sizeof(int));
+        order = malloc(dfa->n * sizeof(int));
+        tmp   = malloc(dfa->ncols * sizeof(int));
+
+        max = 2 * dfa->ncols;
+        nxt = malloc(max * sizeof(int));
+        chk = malloc(max * sizeof(int));
+
+        if (!base || !def || !count || !order || !tmp || !nxt || !chk)
+                halt(SIGABRT, "print_comb: Out of memory.\n");
+
+        for (i=0; i<max; i++)
+                chk[i] = F;
+
+        for (s=0; s<dfa->n; s++) {
+                row    = &dfa->trans[s * dfa->ncols];
+                def[s] = row_default(row, dfa->ncols, tmp);
+
+                for (c=0; c<dfa->ncols; c++) {
+                        if (row[c] != def[s])
+                                count[s]++;
+                }
+                order[s] = s;
+        }
+
+        sort_count = count;
+        qsort(order, dfa->n, sizeof(int), count_cmp);
+
+        for (size=dfa->ncols, lo=0, i=0; i<dfa->n; i++) {
+                s   = order[i];
+                row = &dfa->trans[s * dfa->ncols];
+
+                /* Find the lowest base where the stored entries fit. */
+                for (b=lo; ; b++) {
+                        if (b + dfa->ncols > max) {
+                                max *= 2;
+                                nxt = realloc(nxt, max * sizeof(int));
+                                chk = realloc(chk, max * sizeof(int));
+
+                                if (!nxt || !chk)
+                                        halt(SIGABRT, "print_comb: Out of memory.\n");
+
+                                for (c=max/2; c<max; c++)
+                                        chk[c] = F;
+                        }
+                        for (c=0; c<dfa->ncols; c++) {
+                                if (row[c] != def[s] && chk[b+c] != F)
+                                        break;
+                        }
+                        if (c == dfa->ncols)
+                                break;
+                }
+
+                base[s] = b;
+
+                for (c=0; c<dfa->ncols; c++) {
+                        if (row[c] != def[s]) {
+                                nxt[b+c] = row[c];
+                                chk[b+c] = s;
+                        }
+                }
+
+                if (b + dfa->ncols > size)
+                        size = b + dfa->ncols;
+
+                while (lo < size && chk[lo] != F)
+                        lo++;
+        }
+
+        for (i=0; i<size; i++) {
+                if (chk[i] == F)
+                        nxt[i] = F;
+        }
+
+        /* Report the savings, in bytes of table. */
+        if (dfa->verbose) {
+                dense = dfa->n * dfa->ncols * (int)sizeof(int);
+                comb  = (2 * dfa->n + 2 * size) * (int)sizeof(int);
+
+                fprintf(stderr, "Comb: %d slots for %d states x %d classes, %.1f%% of the dense table.\n",
+                        size, dfa->n, dfa->ncols, 100.0 * comb / dense);
+        }
+
+        fprintf(fp, "/*\n"
+                    " * Comb-vector transition table. Row s of the table is\n"
+                    " * overlaid on the others at %s[s]; a slot belongs to s\n"
+                    " * if %s[slot] == s, and any other column of the row\n"
+                    " * holds the default transition %s[s].\n"
+                    " */\n", BASE_NAME, CHECK_NAME, DEF_NAME);
+
+        fprintf(fp, "typedef %s YY_BTYPE;\n\n", uint_type(size));
+
+        fprintf(fp, "YYPRIVATE const YY_BTYPE  %s[%d] =\n", BASE_NAME, dfa->n);
+        print_vector(fp, base, dfa->n);
+
+        fprintf(fp, "\nYYPRIVATE const YY_TTYPE  %s[%d] =\n", DEF_NAME, dfa->n);
+        print_vector(fp, def, dfa->n);
+
+        fprintf(fp, "\nYYPRIVATE const YY_TTYPE  %s[%d] =\n", DTRAN_NAME, size);
+        print_vector(fp, nxt, size);
+
+        fprintf(fp, "\nYYPRIVATE const YY_TTYPE  %s[%d] =\n", CHECK_NAME, size);
+        print_vector(fp, chk, size);
+
+        fprintf(fp, "\n"
+                    "/*\n"
+                    " * yy_next(state,c) is given the current state and input\n"
+                    " * character and evaluates to the next state.\n"
+                    " */\n"
+                    "static inline int yy_next(int state, int c)\n"
+                    "{\n"
+                    "        int i = %s[state] + %s[c];\n"
+                    "\n"
+                    "        return (%s[i] == state) ? %s[i] : %s[state];\n"
+                    "}\n",
+                    BASE_NAME, ECMAP_NAME, CHECK_NAME, DTRAN_NAME, DEF_NAME);
+
+        free(base);
+        free(def);
+        free(count);
+        free(order);
+        free(tmp);
+        free(nxt);
+        free(chk);
+}
+
+
+
+/******************************************************************************
+ * DEDUPLICATED TABLES
+ *
+ * Identical rows of the transition table are stored once, and so are
+ * identical columns. Yy_rmap[] maps each state to its row, and yy_cmap[]
+ * maps each character straight to its column, by way of its class, so
+ * a lookup is
+ *
+ *      next = Yy_nxt[Yy_rmap[s]][yy_cmap[c]];
+ *
+ * which is one more load than the dense table, for a table that is
+ * often a fraction of the size.
+ ******************************************************************************/
+
+/* Compare two vectors of sort_len ints at the given indices of sort_vec. */
+static int *sort_vec;
+static int  sort_len;
+
+static int vec_cmp(const void *a, const void *b)
+{
+        int x = *(const int *)a;
+        int y = *(const int *)b;
+        int r;
+
+        if ((r = memcmp(&sort_vec[x * sort_len], &sort_vec[y * sort_len], sort_len * sizeof(int))))
+                return r;
+
+        return x - y;
+}
+
+
+/**
+ * dedup
+ * `````
+ * Number the distinct vectors in an array of vectors.
+ *
+ * @vec  : @n vectors of @len ints each, one after another.
+ * @n    : Number of vectors.
+ * @len  : Length of each vector.
+ * @id   : Number of the distinct vector equal to each vector (output).
+ * @first: First vector with each number (output).
+ * Return: Number of distinct vectors.
+ *
+ * NOTE
+ * Distinct vectors are numbered in order of their first appearance.
+ */
+static int dedup(int *vec, int n, int len, int *id, int *first)
+{
+        int *order;
+        int *rep;   // Lowest index of an equal vector.
+        int k;
+        int i;
+
+        order = malloc(n * sizeof(int));
+        rep   = malloc(n * sizeof(int));
+
+        if (!order || !rep)
+                halt(SIGABRT, "dedup: Out of memory.\n");
+
+        for (i=0; i<n; i++)
+                order[i] = i;
+
+        sort_vec = vec;
+        sort_len = len;
+        qsort(order, n, sizeof(int), vec_cmp);
+
+        /* Equal vectors are now adjacent, lowest index first. */
+        for (i=0; i<n; i++) {
+                if (i > 0 && !memcmp(&vec[order[i] * len], &vec[order[i-1] * len], len * sizeof(int)))
+                        rep[order[i]] = rep[order[i-1]];
+                else
+                        rep[order[i]] = order[i];
+        }
+
+        for (k=0, i=0; i<n; i++) {
+                if (rep[i] == i) {
+                        first[k] = i;
+                        id[i]    = k++;
+                } else {
+                        id[i] = id[rep[i]];
+                }
+        }
+
+        free(order);
+        free(rep);
+
+        return k;
+}
+
+
+/******************************************************************************
+ * SKIP STATES
+ *
+ * A state that loops back to itself on all but a few characters, like
+ * the inside of a comment or a string, hands the input to io_skip(),
+ * which runs to the next of those characters a vector at a time.
+ ******************************************************************************/
+
+/**
+ * escapes
+ * ```````
+ * List the characters that take a state anywhere but back to itself.
+ *
+ * @dfa  : DFA object.
+ * @s    : State.
+ * @esc  : Escape characters (output), room for IO_ESCMAX.
+ * Return: Number of escape characters, or -1 if there are too many for
+ *         the state to be skipped through.
+ */
+static int escapes(struct dfa_t *dfa, int s, unsigned char *esc)
+{
+        int n = 0;
+        int c;
+
+        for (c=0; c<MAX_CHARS; c++) {
+                if (dfa->trans[s * dfa->ncols + dfa->ec[c]] == s)
+                        continue;
+                if (n == IO_ESCMAX)
+                        return -1;
+                esc[n++] = c;
+        }
+
+        return n;
+}
+
+
+/**
+ * print_skip
+ * ``````````
+ * Print the escape characters of the skip states, for the table-driven
+ * scanners.
+ *
+ * @fp   : output stream.
+ * @dfa  : DFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * Yy_esc[0] is a placeholder, so that Yy_skip[s] is 0 for a state that
+ * isn't skipped and can be tested as is.
+ */
+void print_skip(FILE *fp, struct dfa_t *dfa)
+{
+        unsigned char esc[IO_ESCMAX];
+        int *skip;
+        int nskip = 0;
+        int s;
+        int n;
+        int i;
+
+        if (!(skip = calloc(dfa->n, sizeof(int))))
+                halt(SIGABRT, "print_skip: Out of memory.\n");
+
+        for (s=0; s<dfa->n; s++) {
+                if (escapes(dfa, s, esc) >= 0)
+                        skip[s] = ++nskip;
+        }
+
+        if (nskip == 0) {
+                free(skip);
+                return;
+        }
+
+        if (dfa->verbose)
+                fprintf(stderr, "Skip: %d states loop on all but %d characters or fewer.\n", nskip, IO_ESCMAX);
+
+        fprintf(fp, "\n"
+                    "/*\n"
+                    " * Yy_skip[s] is nonzero if state s loops back to itself on\n"
+                    " * every character but the ones in Yy_esc[Yy_skip[s]], which\n"
+                    " * io_skip() can then run to directly.\n"
+                    " */\n"
+                    "#define YY_SKIP\n\n"
+                    "YYPRIVATE const struct {\n"
+                    "        int n;\n"
+                    "        unsigned char c[%d];\n"
+                    "} Yy_esc[%d] = {\n"
+                    "        { 0, \"\" },\n", IO_ESCMAX, nskip + 1);
+
+        for (s=0; s<dfa->n; s++) {
+                if (!skip[s])
+                        continue;
+
+                n = escapes(dfa, s, esc);
+
+                fprintf(fp, "        { %d, { ", n);
+
+                for (i=0; i<n; i++)
+                        fprintf(fp, "%d%s", esc[i], (i < n-1) ? ", " : "");
+
+                fprintf(fp, " } },  /* State %d */\n", s);
+        }
+
+        fprintf(fp, "};\n\n"
+                    "YYPRIVATE const %s Yy_skip[%d] =\n", uint_type(nskip), dfa->n);
+
+        print_vector(fp, skip, dfa->n);
+
+        free(skip);
+}
+
+
+
+/**
+ * print_first
+ * ```````````
+ * Print the set of characters on which the start state has a transition,
+ * so that bad input can be skipped up to the next of them at once.
+ *
+ * @fp   : output stream.
+ * @dfa  : DFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * Nothing is printed if every character can start a token, since then
+ * there is nothing to skip.
  */
-void defnext(FILE *fp, char *name)
+void print_first(FILE *fp, struct dfa_t *dfa)
 {
+        unsigned char set[MAX_CHARS / 8] = { 0 };
+        int n = 0;
+        int c;
+
+        for (c=0; c<MAX_CHARS; c++) {
+                if (dfa->trans[dfa->ec[c]] != F) { // Row 0, the start state.
+                        set[c / 8] |= 1 << (c % 8);
+                        n++;
+                }
+        }
+
+        if (n == MAX_CHARS)
+                return;
+
+        fprintf(fp, "\n"
+                    "/*\n"
+                    " * Yy_first is the set of characters some rule can start\n"
+                    " * with, as a bitmap. Bad input is skipped up to the next\n"
+                    " * one of them.\n"
+                    " */\n"
+                    "#define YY_FIRST\n\n"
+                    "YYPRIVATE const unsigned char Yy_first[%d] =\n"
+                    "{\n", MAX_CHARS / 8);
+
+        for (c=0; c<MAX_CHARS / 8; c++) {
+                fprintf(fp, "%s0x%02x%s", (c % 8) ? " " : "        ", set[c],
+                            (c == MAX_CHARS / 8 - 1) ? "\n" : ((c % 8) == 7) ? ",\n" : ",");
+        }
+
+        fprintf(fp, "};\n");
+}
+
+
+
+/******************************************************************************
+ * DIRECT-CODED STATES
+ *
+ * Instead of tables, each state of the DFA is printed as a block of
+ * code that switches on the lookahead character and jumps straight to
+ * the block of the next state:
+ *
+ *      yy_a7:  advance past the character, and if state 7 is accepting,
+ *              remember it;
+ *      yy_s7:  switch (io_look(1)) { case 'x': goto yy_a12; ... }
+ *
+ * so the next state is never loaded from memory, and only accepting
+ * states pay for the accept bookkeeping. The whole machine is a single
+ * function, yy_run(), which the driver calls when YY_DIRECT is defined.
+ ******************************************************************************/
+
+/**
+ * print_cases
+ * ```````````
+ * Print the case labels for the characters that take a state to @next.
+ *
+ * @fp   : output stream.
+ * @dfa  : DFA object.
+ * @s    : State.
+ * @next : Target state.
+ * Return: Nothing.
+ */
+static void print_cases(FILE *fp, struct dfa_t *dfa, int s, int next)
+{
+        int n = 0;
+        int c;
+
+        for (c=0; c<MAX_CHARS; c++) {
+                if (dfa->trans[s * dfa->ncols + dfa->ec[c]] != next)
+                        continue;
+
+                if (n && !(n % 8))
+                        fprintf(fp, "\n");
+
+                fprintf(fp, (n % 8) ? " case %d:" : "        case %d:", c);
+                n++;
+        }
+        fprintf(fp, "\n");
+}
+
+
+/**
+ * print_goto
+ * ``````````
+ * Print the jump from state @s to state @next.
+ */
+static void print_goto(FILE *fp, struct accept_t *accept, int s, int next)
+{
+        if (next == F)
+                fprintf(fp, "                goto yy_fail;\n");
+        else if (accept[next].string)
+                fprintf(fp, "                yyp = %d;\n                goto yy_a%d;\n", s, next);
+        else
+                fprintf(fp, "                goto yy_a%d;\n", next);
+}
+
+
+/**
+ * print_direct
+ * ````````````
+ * Print the DFA as the function yy_run(), with one labelled block per
+ * state.
+ *
+ * @fp    : output stream.
+ * @dfa   : DFA object.
+ * @accept: accepting string and anchor of each state.
+ * Return : Nothing.
+ *
+ * NOTES
+ * The most common target of each state, which is often the failure
+ * transition, is left to the default case.
+ */
+void print_direct(FILE *fp, struct dfa_t *dfa, struct accept_t *accept)
+{
+        unsigned char esc[IO_ESCMAX];
+        int *count;   // Number of characters going to each target, F at [dfa->n].
+        bool *target; // States that some transition goes to.
+        int common;
+        int next;
+        int s, c, i, n;
+
+        count  = malloc((dfa->n + 1) * sizeof(int));
+        target = calloc(dfa->n, sizeof(bool));
+
+        if (!count || !target)
+                halt(SIGABRT, "print_direct: Out of memory.\n");
+
+        for (i=0; i<dfa->n * dfa->ncols; i++) {
+                if (dfa->trans[i] != F)
+                        target[dfa->trans[i]] = true;
+        }
+
+        fprintf(fp, "#define YY_DIRECT\n\n"
+                    "/*\n"
+                    " * yy_run(io, state, prevp, anchorp) runs the DFA from the\n"
+                    " * given state until no transition is possible, advancing io\n"
+                    " * past the characters it takes. It returns the last accepting state\n"
+                    " * that was reached, 0 if none, or -1 if the input ran out\n"
+                    " * before any was. The state before the accepting state and\n"
+                    " * its anchor are stored through prevp and anchorp.\n"
+                    " */\n"
+                    "YYPRIVATE int yy_run(struct io_t *yyio, int yystate, int *yyprev, int *yyanchor)\n"
+                    "{\n"
+                    "        int yylastaccept = 0;\n"
+                    "        int yyp = 0;\n"
+                    "        int yya = 0;\n\n"
+                    "        switch (yystate) {\n");
+
+        for (s=0; s<dfa->n; s++)
+                fprintf(fp, "        case %d: goto yy_s%d;\n", s, s);
+
+        fprintf(fp, "        default: goto yy_fail;\n"
+                    "        }\n\n");
+
+        for (s=0; s<dfa->n; s++) {
+                /* A state that is only ever started in has no entry. */
+                if (target[s]) {
+                        fprintf(fp, "yy_a%d:\n"
+                                    "        io_advance_r(yyio);\n", s);
+
+                        if (accept[s].string) {
+                                fprintf(fp, "        yylastaccept = %d;\n"
+                                            "        yya = %d;\n"
+                                            "        io_mark_end_r(yyio);\n",
+                                            s, accept[s].anchor ? accept[s].anchor : 4);
+                        }
+                }
+
+                /* Find the most common target of the state. */
+                memset(count, 0, (dfa->n + 1) * sizeof(int));
+
+                for (c=0; c<MAX_CHARS; c++) {
+                        next = dfa->trans[s * dfa->ncols + dfa->ec[c]];
+                        count[(next == F) ? dfa->n : next]++;
+                }
+
+                for (common=dfa->n, next=0; next<dfa->n; next++) {
+                        if (count[next] > count[common])
+                                common = next;
+                }
+
+                if (common == dfa->n)
+                        common = F;
+
+                fprintf(fp, "yy_s%d:\n", s);
+
+                /* Run through the characters the state loops on. */
+                if ((n = escapes(dfa, s, esc)) >= 0) {
+                        fprintf(fp, (accept[s].string) ? "        if (io_skip_r(yyio, (const unsigned char *)" : "        io_skip_r(yyio, (const unsigned char *)");
+                        print_string(fp, esc, n);
+                        fprintf(fp, ", %d)", n);
+
+                        if (accept[s].string) {
+                                fprintf(fp, " > 0) {\n"
+                                            "                yylastaccept = %d;\n"
+                                            "                yyp = %d;\n"
+                                            "                yya = %d;\n"
+                                            "                io_mark_end_r(yyio);\n"
+                                            "        }\n",
+                                            s, s, accept[s].anchor ? accept[s].anchor : 4);
+                        } else {
+                                fprintf(fp, ";\n");
+                        }
+                }
+
+                fprintf(fp, "        switch (io_look_r(yyio, 1)) {\n"
+                            "        case EOF:\n"
+                            "                goto yy_eof;\n");
+
+                for (next=0; next<dfa->n; next++) {
+                        if (count[next] && next != common) {
+                                print_cases(fp, dfa, s, next);
+                                print_goto(fp, accept, s, next);
+                        }
+                }
+
+                if (count[dfa->n] && common != F) {
+                        print_cases(fp, dfa, s, F);
+                        print_goto(fp, accept, s, F);
+                }
+
+                fprintf(fp, "        default:\n");
+                print_goto(fp, accept, s, common);
+                fprintf(fp, "        }\n\n");
+        }
+
+        fprintf(fp, "yy_eof:\n"
+                    "        if (!yylastaccept)\n"
+                    "                return -1;\n"
+                    "yy_fail:\n"
+                    "        if (yylastaccept) {\n"
+                    "                *yyprev   = yyp;\n"
+                    "                *yyanchor = yya;\n"
+                    "        }\n"
+                    "        return yylastaccept;\n"
+                    "}\n");
+
+        free(count);
+        free(target);
+}
+
+
+
+/******************************************************************************
+ * KEYWORDS
+ ******************************************************************************/
+
+/**
+ * print_keywords
+ * ``````````````
+ * Print the perfect hash table of the keywords taken out of the rules,
+ * and yy_keyword(), which the general rules call to look a lexeme up.
+ *
+ * @fp   : output stream.
+ * @kw   : keyword set.
+ * Return: Nothing.
+ *
+ * NOTES
+ * yy_kwhash() must compute the same function as kw_hash().
+ */
+void print_keywords(FILE *fp, struct kwset_t *kw)
+{
+        struct keyword_t *k;
+        int s;
+
+        fprintf(fp, "\n"
+                    "/*\n"
+                    " * Keywords taken out of the rules. A lexeme is in bucket\n"
+                    " * yy_kwhash(0) %% %d, and bucket b is in slot\n"
+                    " * yy_kwhash(%s[b]) %% %d, where each keyword has a slot\n"
+                    " * to itself.\n"
+                    " */\n"
+                    "#define YY_KEYWORDS\n\n", kw->nbuckets, DISP_NAME, kw->nslots);
+
+        fprintf(fp, "YYPRIVATE const uint32_t  %s[%d] =\n", DISP_NAME, kw->nbuckets);
+        print_vector(fp, kw->disp, kw->nbuckets);
+
+        fprintf(fp, "\nYYPRIVATE const struct {\n"
+                    "        const char *str;\n"
+                    "        int len;\n"
+                    "        int rule;\n"
+                    "} %s[%d] = {\n", KW_NAME, kw->nslots);
+
+        for (s=0; s<kw->nslots; s++) {
+                if (kw->slot[s] < 0) {
+                        fprintf(fp, "        { 0, 0, 0 },\n");
+                } else {
+                        k = &kw->kw[kw->slot[s]];
+                        fprintf(fp, "        { ");
+                        print_string(fp, k->str, k->len);
+                        fprintf(fp, ", %d, %d },\n", k->len, k->rule);
+                }
+        }
+
+        fprintf(fp, "};\n\n");
+
+        fprintf(fp, "YYPRIVATE uint32_t yy_kwhash(const unsigned char *s, int len, uint32_t seed)\n"
+                    "{\n"
+                    "        uint32_t h = 2166136261u ^ seed;\n\n"
+                    "        while (len--) {\n"
+                    "                h ^= *s++;\n"
+                    "                h *= 16777619u;\n"
+                    "        }\n\n"
+                    "        h ^= h >> 16;\n"
+                    "        h *= 0x85ebca6b;\n"
+                    "        h ^= h >> 13;\n"
+                    "        h *= 0xc2b2ae35;\n"
+                    "        h ^= h >> 16;\n\n"
+                    "        return h;\n"
+                    "}\n\n");
+
+        fprintf(fp, "/*\n"
+                    " * yy_keyword(s, len) is the number of the keyword rule\n"
+                    " * for the lexeme s, or 0 if it is not a keyword.\n"
+                    " */\n"
+                    "YYPRIVATE int yy_keyword(const unsigned char *s, int len)\n"
+                    "{\n"
+                    "        uint32_t i;\n\n"
+                    "        i = yy_kwhash(s, len, %s[yy_kwhash(s, len, 0) %% %d]) %% %d;\n\n"
+                    "        if (%s[i].len == len && !memcmp(%s[i].str, s, len))\n"
+                    "                return %s[i].rule;\n\n"
+                    "        return 0;\n"
+                    "}\n",
+                    DISP_NAME, kw->nbuckets, kw->nslots, KW_NAME, KW_NAME, KW_NAME);
+}
+
+
+
+/**
+ * print_rules
+ * ```````````
+ * Print the number of the rule each state accepts, for yylex_batch(),
+ * which returns it in place of running the action.
+ *
+ * @fp    : output stream.
+ * @nrows : number of states.
+ * @accept: accepting string and rule of each state.
+ * @kw    : keywords taken out of the rules, or NULL.
+ * Return : Nothing.
+ *
+ * NOTES
+ * A general rule that keywords were taken out of is printed negated,
+ * so that the lexeme is looked up with yy_keyword() first.
+ */
+void print_rules(FILE *fp, int nrows, struct accept_t *accept, struct kwset_t *kw)
+{
+        int *rule;
+        int s, i;
+
+        if (!(rule = calloc(nrows, sizeof(int))))
+                halt(SIGABRT, "print_rules: Out of memory.\n");
+
+        for (s=0; s<nrows; s++) {
+                if (!accept[s].string)
+                        continue;
+
+                rule[s] = accept[s].rule;
+
+                for (i=0; kw && i<kw->n; i++) {
+                        if (kw->kw[i].owner->rule == accept[s].rule) {
+                                rule[s] = -accept[s].rule;
+                                break;
+                        }
+                }
+        }
+
+        fprintf(fp, "\n"
+                    "/*\n"
+                    " * Yy_rule is the rule each state accepts, counting from 1,\n"
+                    " * or 0. The actions are left out, and yylex_batch() returns\n"
+                    " * the rules instead. A negative rule has keywords in it.\n"
+                    " */\n"
+                    "#define YY_BATCH\n\n"
+                    "YYPRIVATE const int Yy_rule[%d] =\n", nrows);
+
+        print_vector(fp, rule, nrows);
+
+        free(rule);
+}
+
+
+
+/**
+ * print_dedup
+ * ```````````
+ * Remove repeated rows and columns from the transition table, and print
+ * what is left, along with the maps and a yy_next() to read them.
+ *
+ * @fp   : output stream.
+ * @dfa  : DFA object.
+ * Return: Nothing.
+ *
+ * NOTES
+ * The column map is composed with the class map, so yy_cmap[] replaces
+ * yy_ec[] and the class of a character is never looked up on its own.
+ */
+void print_dedup(FILE *fp, struct dfa_t *dfa)
+{
+        int *cols;   // The table, transposed.
+        int *colid;  // Distinct column of each class.
+        int *colrep; // Class with each distinct column.
+        int *rows;   // The table, with only the distinct columns.
+        int *rowid;  // Distinct row of each state.
+        int *rowrep; // State with each distinct row.
+        int *cmap;
+        int *table;
+        int ncols;
+        int nrows;
+        int dense;
+        int small;
+        int s, c, i;
+
+        cols   = malloc(dfa->n * dfa->ncols * sizeof(int));
+        colid  = malloc(dfa->ncols * sizeof(int));
+        colrep = malloc(dfa->ncols * sizeof(int));
+        rowid  = malloc(dfa->n * sizeof(int));
+        rowrep = malloc(dfa->n * sizeof(int));
+        cmap   = malloc(MAX_CHARS * sizeof(int));
+
+        if (!cols || !colid || !colrep || !rowid || !rowrep || !cmap)
+                halt(SIGABRT, "print_dedup: Out of memory.\n");
+
+        for (s=0; s<dfa->n; s++) {
+                for (c=0; c<dfa->ncols; c++)
+                        cols[c * dfa->n + s] = dfa->trans[s * dfa->ncols + c];
+        }
+
+        ncols = dedup(cols, dfa->ncols, dfa->n, colid, colrep);
+
+        if (!(rows = malloc(dfa->n * ncols * sizeof(int))))
+                halt(SIGABRT, "print_dedup: Out of memory.\n");
+
+        for (s=0; s<dfa->n; s++) {
+                for (c=0; c<ncols; c++)
+                        rows[s * ncols + c] = dfa->trans[s * dfa->ncols + colrep[c]];
+        }
+
+        nrows = dedup(rows, dfa->n, ncols, rowid, rowrep);
+
+        /* Gather the distinct rows into the table that is printed. */
+        if (!(table = malloc(nrows * ncols * sizeof(int))))
+                halt(SIGABRT, "print_dedup: Out of memory.\n");
+
+        for (i=0; i<nrows; i++)
+                memcpy(&table[i * ncols], &rows[rowrep[i] * ncols], ncols * sizeof(int));
+
+        for (c=0; c<MAX_CHARS; c++)
+                cmap[c] = colid[dfa->ec[c]];
+
+        /* Report the savings, in entries of table and maps. */
+        if (dfa->verbose) {
+                dense = dfa->n * dfa->ncols + MAX_CHARS;
+                small = nrows * ncols + dfa->n + MAX_CHARS;
+
+                fprintf(stderr, "Dedup: %d rows x %d columns of %d x %d, %.1f%% of the dense table.\n",
+                        nrows, ncols, dfa->n, dfa->ncols, 100.0 * small / dense);
+        }
+
         fprintf(fp, "/*\n"
+                    " * %s[c] is the column of character c, and %s[s]\n"
+                    " * the row of state s, in the transition table. Repeated\n"
+                    " * rows and columns are only stored once.\n"
+                    " */\n", CMAP_NAME, RMAP_NAME);
+
+        fprintf(fp, "YYPRIVATE const unsigned char  %s[%d] =\n", CMAP_NAME, MAX_CHARS);
+        print_ec(fp, cmap, MAX_CHARS);
+
+        fprintf(fp, "\ntypedef %s YY_RTYPE;\n\n", uint_type(nrows));
+
+        fprintf(fp, "YYPRIVATE const YY_RTYPE  %s[%d] =\n", RMAP_NAME, dfa->n);
+        print_vector(fp, rowid, dfa->n);
+
+        fprintf(fp, "\nYYPRIVATE const YY_TTYPE  %s[%d][%d] =\n", DTRAN_NAME, nrows, ncols);
+        print_array(fp, table, nrows, ncols);
+
+        fprintf(fp, "\n"
+                    "/*\n"
                     " * yy_next(state,c) is given the current state and input\n"
                     " * character and evaluates to the next state.\n"
                     " */\n"
-                    "#define yy_next(state, c) %s[state][c]\n", name);
+                    "#define yy_next(state, c) %s[%s[state]][%s[c]]\n",
+                    DTRAN_NAME, RMAP_NAME, CMAP_NAME);
+
+        free(cols);
+        free(colid);
+        free(colrep);
+        free(rows);
+        free(rowid);
+        free(rowrep);
+        free(cmap);
+        free(table);
 }
 
 
@@ -228,17 +1344,63 @@ void print_driver(struct pgen_t *pgen, struct dfa_t *dfa, struct accept_t *accep
 {
         driver(pgen->out, DRIVER_HEADER);
 
-        /* Print the DFA transition table to the output stream. */
-        fprintf(pgen->out,
-                "YYPRIVATE YY_TTYPE  %s[%d][%d] =\n", 
-                DTRAN_NAME, dfa->n, dfa->max);
+        /* Size the table entries to the number of states. */
+        if (pgen->table != TABLE_DIRECT)
+                print_ttype(pgen->out, dfa->n);
+
+        /* The deduplicated tables map characters on their own. */
+        if (pgen->table != TABLE_DEDUP && pgen->table != TABLE_DIRECT)
+                print_ecmap(pgen->out, dfa);
+
+        switch (pgen->table) {
+        case TABLE_COMB:
+                print_comb(pgen->out, dfa);
+                break;
+        case TABLE_DEDUP:
+                print_dedup(pgen->out, dfa);
+                break;
+        case TABLE_DIRECT:
+                print_direct(pgen->out, dfa, accept);
+                break;
+        case TABLE_DENSE:
+        default:
+                /* Print the DFA transition table to the output stream. */
+                fprintf(pgen->out,
+                        "YYPRIVATE const YY_TTYPE  %s[%d][%d] =\n", 
+                        DTRAN_NAME, dfa->n, dfa->ncols);
+
+                /* Print the DFA array to the output stream. */
+	        print_array(pgen->out, dfa->trans, dfa->n, dfa->ncols);
+
+	        defnext(pgen->out, DTRAN_NAME, ECMAP_NAME);
+                break;
+        }
+
+        /* The coded states call io_skip() on their own. */
+        if (pgen->table != TABLE_DIRECT)
+                print_skip(pgen->out, dfa);
+
+        print_first(pgen->out, dfa);
+
+        if (pgen->kw && pgen->kw->n > 0) {
+                print_keywords(pgen->out, pgen->kw);
+
+                if (pgen->verbose)
+                        fprintf(stderr, "Keywords: %d rules in a table of %d slots.\n", 
+                                pgen->kw->n, pgen->kw->nslots);
+        }
 
-        /* Print the DFA array to the output stream. */
-	print_array(pgen->out, dfa->trans, dfa->n, MAX_CHARS);
+        if (pgen->batch)
+                print_rules(pgen->out, dfa->n, accept, pgen->kw);
 
-	defnext(pgen->out, DTRAN_NAME);
+        /* The coded states keep track of accepting on their own. */
+        if (pgen->table != TABLE_DIRECT)
+                print_accept(pgen->out, dfa->n, accept);
 
-        /* Print the rest of the driver and everyting after the second %% */
-	pdriver(pgen->out, dfa->n, accept);	
+        /* 
+         * Print the rest of the driver and everyting after the second %%.
+         * A batch scanner has no actions to print.
+         */
+	pdriver(pgen->out, pgen->batch ? 0 : dfa->n, accept);	
 }
 
@@ -6,9 +6,21 @@
 
 void print_driver(struct pgen_t *pgen, struct dfa_t *dfa, struct accept_t *accept);
 
-void pheader(FILE *fp, int **dtran, int nrows, struct accept_t *accept);
+void pheader(FILE *fp, int *dtran, int nrows, int ncols, int *ec, struct accept_t *accept);
+void print_accept(FILE *out, int nrows, struct accept_t *accept);
 void pdriver(FILE *out, int nrows, struct accept_t *accept);
-void print_array(FILE *fp, int **array, int nrows, int ncols);
-void defnext(FILE *fp, char *name);
+void print_array(FILE *fp, int *array, int nrows, int ncols);
+void print_ttype(FILE *fp, int nstates);
+void print_vector(FILE *fp, int *vec, int n);
+void print_ecmap(FILE *fp, struct dfa_t *dfa);
+void print_comb(FILE *fp, struct dfa_t *dfa);
+void print_dedup(FILE *fp, struct dfa_t *dfa);
+void print_skip(FILE *fp, struct dfa_t *dfa);
+void print_first(FILE *fp, struct dfa_t *dfa);
+void print_direct(FILE *fp, struct dfa_t *dfa, struct accept_t *accept);
+void print_keywords(FILE *fp, struct kwset_t *kw);
+void print_rules(FILE *fp, int nrows, struct accept_t *accept, struct kwset_t *kw);
+void print_ec(FILE *fp, int *ec, int nchars);
+void defnext(FILE *fp, char *name, char *ecname);
 
 #endif
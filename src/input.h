@@ -2,11 +2,64 @@
 #define _IO_DRIVER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
+/* Most escape characters io_skip() looks for at once. */
+#define IO_ESCMAX 4
+
+/* The state of one input stream. */
+struct io_t;
+
+struct io_t   *io_new(void);
+void           io_del(struct io_t *io);
+struct io_t   *io_std(void);
+void           io_bufsize_r(struct io_t *io, size_t size);
+
+int            io_newfile_r(struct io_t *io, char *name);
+int            io_newmap_r(struct io_t *io, char *name);
+void           io_newbuffer_r(struct io_t *io, const void *buf, size_t len);
+void           io_newstring_r(struct io_t *io, const char *str);
+int            io_newahead_r(struct io_t *io, char *name);
+unsigned char *io_text_r(struct io_t *io);
+int            io_length_r(struct io_t *io);
+int            io_lineno_r(struct io_t *io);
+long           io_offset_r(struct io_t *io);
+unsigned char *io_ptext_r(struct io_t *io);
+int            io_plength_r(struct io_t *io);
+int            io_plineno_r(struct io_t *io);
+unsigned char *io_mark_start_r(struct io_t *io);
+unsigned char *io_mark_end_r(struct io_t *io);
+unsigned char *io_move_start_r(struct io_t *io);
+unsigned char *io_to_mark_r(struct io_t *io);
+unsigned char *io_mark_prev_r(struct io_t *io);
+int            io_advance_r(struct io_t *io);
+int            io_flush_r(struct io_t *io, bool force);
+int            io_fillbuf_r(struct io_t *io, unsigned char *starting_at);
+int            io_look_r(struct io_t *io, int n);
+int            io_pushback_r(struct io_t *io, int n);
+void           io_term_r(struct io_t *io);
+void           io_unterm_r(struct io_t *io);
+int            io_input_r(struct io_t *io);
+void           io_unput_r(struct io_t *io, int c);
+int            io_lookahead_r(struct io_t *io, int n);
+int            io_flushbuf_r(struct io_t *io);
+int            io_skip_r(struct io_t *io, const unsigned char *esc, int nesc);
+int            io_skipset_r(struct io_t *io, const unsigned char *set);
+
+/* Map a whole file just after a newline, as io_newmap() does. */
+unsigned char *io_map_after_newline(int fd, unsigned char **base, size_t *len);
+
+/* The same, on the context returned by io_std(). */
 int            io_newfile(char *name);
+int            io_newmap(char *name);
+void           io_newbuffer(const void *buf, size_t len);
+void           io_newstring(const char *str);
+int            io_newahead(char *name);
+void           io_bufsize(size_t size);
 unsigned char *io_text(void);
 int            io_length(void);
 int            io_lineno(void);
+long           io_offset(void);
 unsigned char *io_ptext(void);
 int            io_plength(void);
 int            io_plineno(void);
@@ -26,5 +79,7 @@ int            io_input(void);
 void           io_unput(int c);
 int            io_lookahead(int n);
 int            io_flushbuf(void);
+int            io_skip(const unsigned char *esc, int nesc);
+int            io_skipset(const unsigned char *set);
 
 #endif
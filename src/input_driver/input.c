@@ -2,7 +2,14 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <signal.h>
 
 #include "input.h"
@@ -14,76 +21,506 @@
 /* Maximum amount of lookahead. */
 #define MAXLOOK 16
 
-/* Maximum lexeme size. */
-#define MAXLEX  1024
+/* Size of the buffer, unless io_bufsize() says otherwise. */
+#define BUFSIZE (1 << 16)
 
-/* Number of lexemes in a single buffer. */
-#define NUMLEX  3
-
-/* Manipulate using NUMLEX. */
-#define BUFSIZE ((MAXLEX * NUMLEX) + (2 * MAXLOOK))
+/* Smallest size of the buffer. */
+#define MINBUF  (4 * MAXLOOK)
 
 /* Flush the buffer when "Next" passes this address. */
-#define DANGER (End_buf - MAXLOOK)
+#define DANGER (io->End_buf - MAXLOOK)
 
 /* Just past the last character in buf. */
-#define END (&Start_buf[BUFSIZE])
+#define END (io->Start_buf + io->Bufsize)
 
-#define NO_MORE_CHARS (Eof_read && Next >= End_buf)
+#define NO_MORE_CHARS (io->Eof_read && io->Next >= io->End_buf)
 
 #define STDIN 0
 
+#define min(x, y) (x < y) ? x : y
+
 /******************************************************************************
- * GLOBAL VARIABLES
+ * INPUT CONTEXT
  ******************************************************************************/
 
-/* The input buffer. */
-unsigned char Start_buf[BUFSIZE];
+/**
+ * io_t
+ * ````
+ * Everything there is to know about one input stream.
+ *
+ * NOTES
+ * Each scanner reads through its own context, so that any number of
+ * them can run in one process, one per thread if need be. The functions
+ * with names ending in _r take the context as their first argument.
+ */
+struct io_t {
+        unsigned char *Start_buf; // The input buffer.
+        size_t Bufsize;           // Size of the input buffer.
+        long Offset;              // Input offset of Start_buf[0].
+        unsigned char *End_buf;   // Just past the last character.
+        unsigned char *Next;      // Next input character.
+        unsigned char *sMark;     // Start of current lexeme.
+        unsigned char *eMark;     // End of current lexeme.
+        unsigned char *pMark;     // Start of previous lexeme.
+        int pLineno;              // Line # of previous lexeme.
+        int pLength;              // Length of previous lexeme.
+        int Inp_file;             // Input file handle.
+        int Lineno;               // Line number at Lmark.
+        unsigned char *Lmark;     // Newlines are counted up to here.
 
-/* Just past the last character. */
-unsigned char *End_buf = END;
+        /* 
+         * Holds the character that was overwritten by \0 when we
+         * NUL-terminated the last lexeme.
+         */
+        int Termchar;
 
-/* Next input character. */
-unsigned char *Next = END;
+        /* 
+         * End-of-file has been read. It's possible for this to be true
+         * and for characters to still be in the input buffer.
+         */
+        int Eof_read;
+
+        int been_called;              // The first newline has been pushed.
+        bool Fixed;                   // @Start_buf is the input itself, and
+                                      // isn't ours to write, grow or free.
+        struct io_ahead *Ahead;       // Reader thread, see io_newahead().
+        unsigned char *Map;           // Mapping of the input, if it is one.
+                                      // It is then also @Start_buf.
+        size_t Maplen;                // Length of @Map.
+        bool Nl;                      // The newline in front of a buffer in
+                                      // memory is yet to be read.
+        bool sNl;                     // @Nl, as it was at @sMark.
+        bool eNl;                     // @Nl, as it was at @eMark.
+        const unsigned char *cached;  // Set that @lo_tab was built for.
+        unsigned char lo_tab[2][16];  // Nibble tables of io_skipset().
+};
+
+
+/* 
+ * The context of the functions without the _r. Its buffer is allocated
+ * on first use, as are all the others.
+ */
+static struct io_t Io_std = {
+        .Inp_file = STDIN,
+        .Lineno   = 1
+};
 
-/* Start of current lexeme. */
-unsigned char *sMark = END;
 
-/* End of current lexeme. */
-unsigned char *eMark = END;
+/**
+ * io_alloc
+ * ````````
+ * Allocate the input buffer of a context, if it hasn't got one, and
+ * empty it.
+ */
+static void io_alloc(struct io_t *io)
+{
+        if (io->Start_buf)
+                return;
 
-/* Start of previous lexeme. */
-unsigned char *pMark = END;
+        if (!io->Bufsize)
+                io->Bufsize = BUFSIZE;
 
-/* Line # of previous lexeme. */
-int pLineno = 0;
+        if (!(io->Start_buf = malloc(io->Bufsize))) {
+                fprintf(stderr, "io_alloc: Out of memory.\n");
+                raise(SIGABRT);
+        }
 
-/* Length of previous lexeme. */
-int pLength = 0;
+        io->End_buf = END;
+        io->Next    = END;
+        io->sMark   = END;
+        io->eMark   = END;
+        io->Lmark   = END;
+}
 
-/* Input file handle. */
-int Inp_file = STDIN;
 
-/* Current line number. */
-int Lineno = 1;
+static void io_count(struct io_t *io, unsigned char *to);
 
-/* Line # when mark_end() is called. */
-int Mline = 1;
 
-/* 
- * Holds the character that was overwritten by \0 when we NUL-terminated
- * the last lexeme.
+/**
+ * io_move
+ * ```````
+ * Move the text from @left_edge on to the start of the input buffer,
+ * first giving the buffer a new size.
+ *
+ * @io       : Input context.
+ * @left_edge: First character to keep.
+ * @size     : New size of the buffer, at least enough to hold the text.
+ *
+ * NOTES
+ * The markers are moved with the text. The newlines before @left_edge
+ * are counted first, since they won't be there to count later.
  */
-int  Termchar = 0;
+static void io_move(struct io_t *io, unsigned char *left_edge, size_t size)
+{
+        unsigned char *buf;
+        size_t copy_amt;
 
-/* 
- * End-of-file has been read. It's possible for this to be true and
- * for characters to still be in the input buffer.
+        if (io->Lmark < left_edge)
+                io_count(io, left_edge);
+
+        copy_amt = io->End_buf - left_edge;
+
+        if (size == io->Bufsize) {
+                buf = io->Start_buf;
+                memmove(buf, left_edge, copy_amt);
+        } else {
+                if (!(buf = malloc(size))) {
+                        fprintf(stderr, "io_move: Out of memory.\n");
+                        raise(SIGABRT);
+                }
+
+                memcpy(buf, left_edge, copy_amt);
+        }
+
+        io->Offset += left_edge - io->Start_buf;
+
+        if (io->pMark)
+                io->pMark = buf + (io->pMark - left_edge);
+
+        io->sMark   = buf + (io->sMark - left_edge);
+        io->eMark   = buf + (io->eMark - left_edge);
+        io->Next    = buf + (io->Next  - left_edge);
+        io->Lmark   = buf + (io->Lmark - left_edge);
+        io->End_buf = buf + copy_amt;
+
+        if (buf != io->Start_buf) {
+                free(io->Start_buf);
+                io->Start_buf = buf;
+                io->Bufsize   = size;
+        }
+}
+
+
+/******************************************************************************
+ * READ-AHEAD
+ ******************************************************************************/
+
+/* Blocks in the ring: the one being scanned, and those read ahead of it. */
+#define NAHEAD    2
+
+/* Size of a block read ahead. */
+#define AHEADSIZE (1 << 20)
+
+/* Room in front of a block, for the text kept from the block before. */
+#define AHEADROOM (1 << 16)
+
+/*
+ * The blocks read ahead of the scanner, in a ring. The reader thread
+ * fills the block at @head and then moves @head on; the scanner takes
+ * the block at @tail as its buffer, and moves @tail on when it is done
+ * with it. Each index is written by one thread only, so the handoff
+ * needs no lock. A thread that finds the ring full, or empty, counts
+ * itself in @waiting and sleeps on @moved until the other moves its index
+ * on. The other only takes the lock to wake it if it sees @waiting after
+ * moving its index, which the sequentially consistent order of the two
+ * makes sure of.
  */
-int Eof_read = 0;
+struct io_ahead {
+        pthread_t thread;
+        int fd;                       // File the thread reads.
+        unsigned char *block[NAHEAD]; // Each has AHEADROOM in front of its input,
+                                      // and a byte after it for io_term().
+        ssize_t len[NAHEAD];          // Length of each block, 0 at EOF, -1 on error.
+        bool held;                    // The block at @tail is the buffer.
+        unsigned char *spare;         // Buffer the kept text didn't fit in front of.
+        _Atomic unsigned long head;   // Blocks filled.
+        _Atomic unsigned long tail;   // Blocks given back.
+        _Atomic bool stop;            // The thread is to stop.
+        _Atomic int waiting;          // Threads waiting on @moved.
+        pthread_mutex_t lock;         // Held to wait on, or signal, @moved.
+        pthread_cond_t moved;         // @head or @tail has moved, or @stop is set.
+};
 
 
-#define min(x, y) (x < y) ? x : y
+/**
+ * io_ahead_wait
+ * `````````````
+ * Wait for an index to move on from @from, or for @stop to be set.
+ */
+static void io_ahead_wait(struct io_ahead *ah, _Atomic unsigned long *idx, unsigned long from)
+{
+        if (atomic_load(idx) != from)
+                return;
+
+        pthread_mutex_lock(&ah->lock);
+        atomic_fetch_add(&ah->waiting, 1);
+
+        while (atomic_load(idx) == from && !atomic_load(&ah->stop))
+                pthread_cond_wait(&ah->moved, &ah->lock);
+
+        atomic_fetch_sub(&ah->waiting, 1);
+        pthread_mutex_unlock(&ah->lock);
+}
+
+
+/**
+ * io_ahead_wake
+ * `````````````
+ * Wake the other thread, if it is waiting, after an index has moved.
+ */
+static void io_ahead_wake(struct io_ahead *ah)
+{
+        if (!atomic_load(&ah->waiting))
+                return;
+
+        pthread_mutex_lock(&ah->lock);
+        pthread_cond_broadcast(&ah->moved);
+        pthread_mutex_unlock(&ah->lock);
+}
+
+
+/**
+ * io_ahead_run
+ * ````````````
+ * The reader thread. It fills blocks until the end of the file.
+ *
+ * NOTES
+ * It can only be cancelled in read(), so that it is never cancelled
+ * holding the lock.
+ */
+static void *io_ahead_run(void *arg)
+{
+        struct io_ahead *ah = arg;
+        unsigned long h;
+        ssize_t got;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        for (h=0; ; h++) {
+                /* The block to fill is given back once @tail is past it. */
+                io_ahead_wait(ah, &ah->tail, h - NAHEAD);
+
+                if (atomic_load(&ah->stop))
+                        return NULL;
+
+                pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+                do {
+                        got = read(ah->fd, ah->block[h % NAHEAD] + AHEADROOM, AHEADSIZE);
+                } while (got == -1 && errno == EINTR);
+                pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+                ah->len[h % NAHEAD] = got;
+                atomic_store(&ah->head, h + 1);
+                io_ahead_wake(ah);
+
+                if (got <= 0)
+                        return NULL;
+        }
+}
+
+
+/**
+ * io_ahead_next
+ * `````````````
+ * Make the next block read ahead the input buffer.
+ *
+ * @io         : Input context, with a reader thread.
+ * @starting_at: End of the text in the buffer; moved to the start of the
+ *               input of the new block.
+ * Return      : Characters in the new block, 0 at EOF, -1 on error (and
+ *               then the buffer is left as it is).
+ *
+ * NOTES
+ * The text kept, from the leftmost marker to @starting_at, is copied into
+ * the room in front of the block, and the markers are moved with it. The
+ * input itself isn't copied, and the block before is given back to the
+ * reader thread. Text that doesn't fit in the room, a long lexeme say,
+ * is copied with the block into a buffer of its own, and then both
+ * blocks are given back.
+ */
+static ssize_t io_ahead_next(struct io_t *io, unsigned char **starting_at)
+{
+        struct io_ahead *ah = io->Ahead;
+        unsigned char *left_edge;
+        unsigned char *old;
+        unsigned char *buf;
+        unsigned long t;
+        size_t keep;
+        ssize_t got;
+        int k;
+
+        t = atomic_load_explicit(&ah->tail, memory_order_relaxed) + ah->held;
+
+        io_ahead_wait(ah, &ah->head, t);
+
+        k = t % NAHEAD;
+
+        /* The end of the file, or an error, and the thread is done. */
+        if ((got = ah->len[k]) <= 0)
+                return got;
+
+        left_edge = io->pMark ? min(io->sMark, io->pMark) : io->sMark;
+        keep      = *starting_at - left_edge;
+        old       = ah->spare;
+
+        if (io->Lmark < left_edge)
+                io_count(io, left_edge);
+
+        if (keep <= AHEADROOM) {
+                buf = ah->block[k] + AHEADROOM - keep;
+                memmove(buf, left_edge, keep);
+                ah->spare = NULL;
+        } else {
+                if (!(buf = malloc(keep + got + 1))) {
+                        fprintf(stderr, "io_ahead_next: Out of memory.\n");
+                        raise(SIGABRT);
+                }
+
+                memcpy(buf, left_edge, keep);
+                memcpy(buf + keep, ah->block[k] + AHEADROOM, got);
+                ah->spare = buf;
+        }
+
+        io->Offset += left_edge - io->Start_buf;
+
+        if (io->pMark)
+                io->pMark = buf + (io->pMark - left_edge);
+
+        io->sMark     = buf + (io->sMark - left_edge);
+        io->eMark     = buf + (io->eMark - left_edge);
+        io->Next      = buf + (io->Next  - left_edge);
+        io->Lmark     = buf + (io->Lmark - left_edge);
+        io->Start_buf = buf;
+        io->Bufsize   = keep + got;
+        *starting_at  = buf + keep;
+
+        free(old);
+
+        /* Give back the block before, and this one too if it was copied. */
+        if (ah->spare)
+                t++;
+
+        ah->held = !ah->spare;
+
+        if (t != atomic_load_explicit(&ah->tail, memory_order_relaxed)) {
+                atomic_store(&ah->tail, t);
+                io_ahead_wake(ah);
+        }
+
+        return got;
+}
+
+
+/**
+ * io_ahead_stop
+ * `````````````
+ * Stop the reader thread of a context, if it has one, and free its
+ * blocks. The context is then left without a buffer.
+ */
+static void io_ahead_stop(struct io_t *io)
+{
+        struct io_ahead *ah = io->Ahead;
+        int k;
+
+        if (!ah)
+                return;
+
+        /* It may be waiting on a block, or on the file. */
+        atomic_store(&ah->stop, true);
+        io_ahead_wake(ah);
+        pthread_cancel(ah->thread);
+        pthread_join(ah->thread, NULL);
+
+        pthread_mutex_destroy(&ah->lock);
+        pthread_cond_destroy(&ah->moved);
+
+        for (k=0; k<NAHEAD; k++)
+                free(ah->block[k]);
+
+        free(ah->spare);
+        free(ah);
+
+        io->Ahead     = NULL;
+        io->Start_buf = NULL;
+        io->Bufsize   = 0;
+}
+
+
+/**
+ * io_new
+ * ``````
+ * Create a new input context.
+ *
+ * Return: A context that reads from stdin, until io_newfile_r() is
+ *         called on it.
+ */
+struct io_t *io_new(void)
+{
+        struct io_t *io;
+
+        if (!(io = calloc(1, sizeof(struct io_t)))) {
+                fprintf(stderr, "io_new: Out of memory.\n");
+                raise(SIGABRT);
+        }
+
+        io->Inp_file = STDIN;
+        io->Lineno   = 1;
+
+        return io;
+}
+
+
+/**
+ * io_del
+ * ``````
+ * Free an input context, closing its input file (unless it's stdin).
+ */
+void io_del(struct io_t *io)
+{
+        io_ahead_stop(io);
+
+        if (io->Map)
+                munmap(io->Map, io->Maplen);
+        else if (!io->Fixed)
+                free(io->Start_buf);
+
+        if (io->Inp_file != STDIN)
+                close(io->Inp_file);
+
+        free(io);
+}
+
+
+/**
+ * io_std
+ * ``````
+ * Return: The context that the functions without the _r work on.
+ */
+struct io_t *io_std(void)
+{
+        return &Io_std;
+}
+
+
+/**
+ * io_bufsize_r
+ * ````````````
+ * Set the size of the input buffer.
+ *
+ * @size: Size in bytes. The buffer is refilled when it runs out, and
+ *        the reads take as much as there is room for, which is at
+ *        least half of it.
+ *
+ * NOTES
+ * A large buffer makes for fewer, larger reads. This is best called
+ * before the input is read, but can be called at any time; the buffer
+ * is never made smaller. It grows by itself anyway to hold a lexeme
+ * that doesn't fit. A mapped file, a file read ahead or a buffer in
+ * memory has no buffer to size.
+ */
+void io_bufsize_r(struct io_t *io, size_t size)
+{
+        if (size < MINBUF)
+                size = MINBUF;
+
+        if (io->Fixed || io->Ahead || size <= io->Bufsize)
+                return;
+
+        if (io->Start_buf)
+                io_move(io, io->Start_buf, size);
+        else
+                io->Bufsize = size;
+}
 
 
 /******************************************************************************
@@ -91,8 +528,8 @@ int Eof_read = 0;
  ******************************************************************************/
 
 /**
- * io_newfile
- * ``````````
+ * io_newfile_r
+ * ````````````
  * Prepare a new input file for reading.
  *
  * @name: Path to the input file.
@@ -112,103 +549,383 @@ int Eof_read = 0;
  * At least one free file descriptor must be available when newfile()
  * is called.
  */
-int io_newfile(char *name)
+int io_newfile_r(struct io_t *io, char *name)
 {
         int fd; /* File descriptor */        
 
         if ((fd = (!name) ? STDIN : open(name, O_RDONLY)) != -1) {
 
-                if (Inp_file != STDIN) {
-                        close(Inp_file);
+                io_ahead_stop(io);
+
+                if (io->Inp_file != STDIN) {
+                        close(io->Inp_file);
                 }
 
-                Inp_file = fd;
-                Eof_read = 0;
+                if (io->Fixed) {
+                        if (io->Map)
+                                munmap(io->Map, io->Maplen);
 
-                Next    = END;
-                sMark   = END;
-                eMark   = END;
-                End_buf = END;
-                Lineno  = 1;
-                Mline   = 1;
+                        io->Map       = NULL;
+                        io->Fixed     = false;
+                        io->Start_buf = NULL;
+                        io->Bufsize   = 0;
+                }
+
+                io_alloc(io);
+
+                io->Inp_file = fd;
+                io->Eof_read = 0;
+                io->Nl       = false;
+                io->sNl      = false;
+                io->eNl      = false;
+
+                io->Next    = END;
+                io->sMark   = END;
+                io->eMark   = END;
+                io->End_buf = END;
+                io->pMark   = NULL;
+                io->Lmark   = END;
+                io->Lineno  = 1;
         }
         return fd;
 }
 
 
+/**
+ * io_map_after_newline
+ * ````````````````````
+ * Map the whole of an input file into memory, just after a newline.
+ *
+ * @fd   : Descriptor of the input file.
+ * @base : Receives the start of the mapping, for munmap().
+ * @len  : Receives the length of the mapping.
+ * Return: The newline, followed by the file, or NULL if the file can't 
+ *         be mapped.
+ *
+ * NOTES
+ * The newline is the last byte of an anonymous page, and the file is
+ * mapped over the pages after it, so nothing is copied. A file that
+ * isn't regular, like a pipe, or is empty, can't be mapped.
+ */
+unsigned char *io_map_after_newline(int fd, unsigned char **base, size_t *len)
+{
+        struct stat st;
+        unsigned char *map;
+        size_t page;
+
+        if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+                return NULL;
+
+        page = sysconf(_SC_PAGESIZE);
+
+        map = mmap(NULL, page + st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (map == MAP_FAILED)
+                return NULL;
+
+        if (mmap(map + page, st.st_size, PROT_READ,
+                 MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                munmap(map, page + st.st_size);
+                return NULL;
+        }
+
+        #ifdef MADV_SEQUENTIAL
+        madvise(map + page, st.st_size, MADV_SEQUENTIAL);
+        #endif
+        #ifdef MADV_HUGEPAGE
+        madvise(map + page, st.st_size, MADV_HUGEPAGE);
+        #endif
+
+        map[page - 1] = '\n';
+
+        *base = map;
+        *len  = page + st.st_size;
+
+        return map + page - 1;
+}
+
+
+/**
+ * io_newmap_r
+ * ```````````
+ * Prepare a new input file for reading, by mapping all of it.
+ *
+ * @name : Path to the input file, or NULL for stdin.
+ * Return: As io_newfile_r().
+ *
+ * NOTES
+ * The scanner then runs over the page cache itself: nothing is copied,
+ * the buffer is never flushed, and there's no limit on the length of a
+ * lexeme. The mapping is read-only, so io_term() leaves the lexeme as it
+ * is, and it has to be taken by io_text() and io_length(). io_unput()
+ * can push characters back, but not change them.
+ *
+ * The file is mapped by io_map_after_newline(), so the newline that
+ * io_advance() puts in front of the input is already there. A file that
+ * can't be mapped, like a pipe or an empty file, is read as usual.
+ */
+int io_newmap_r(struct io_t *io, char *name)
+{
+        unsigned char *base;
+        unsigned char *nl;
+        size_t len;
+        int fd;
+
+        if ((fd = io_newfile_r(io, name)) == -1)
+                return -1;
+
+        if (!(nl = io_map_after_newline(fd, &base, &len)))
+                return fd;
+
+        free(io->Start_buf);
+
+        io->Map       = base;
+        io->Fixed     = true;
+        io->Maplen    = len;
+        io->Start_buf = base;
+        io->Bufsize   = len;
+        io->Offset    = -(long)(nl + 1 - base);
+
+        /* What io_advance() does on its first call. */
+        io->Next        = nl;
+        io->sMark       = nl;
+        io->eMark       = nl;
+        io->End_buf     = base + len;
+        io->Eof_read    = 1;
+        io->been_called = 1;
+        io->Lmark       = nl;
+        io->Lineno      = 0;
+
+        return fd;
+}
+
+
+/**
+ * io_newbuffer_r
+ * ``````````````
+ * Prepare a buffer in memory for reading, in place of a file.
+ *
+ * @buf: The input.
+ * @len: Length of @buf.
+ *
+ * NOTES
+ * The scanner runs over @buf itself, which has to stay put until the
+ * context is done with it, and its end is the end of the input. The
+ * buffer isn't written, so lexemes are taken by io_text() and io_length()
+ * as in a mapped file. The input file, if any, is closed.
+ *
+ * As with a file, a newline is read in front of the input, so that a rule
+ * anchored with ^ matches at its very start. There is no room for it in
+ * @buf, so it isn't stored anywhere: io_advance() and io_look() return it
+ * before @buf[0] while @Nl is set. A lexeme that begins with it begins at
+ * @buf[0] all the same, one character shorter than in a file.
+ */
+void io_newbuffer_r(struct io_t *io, const void *buf, size_t len)
+{
+        io_ahead_stop(io);
+
+        if (io->Inp_file != STDIN)
+                close(io->Inp_file);
+
+        if (io->Map)
+                munmap(io->Map, io->Maplen);
+        else if (!io->Fixed)
+                free(io->Start_buf);
+
+        io->Inp_file  = STDIN;
+        io->Map       = NULL;
+        io->Fixed     = true;
+        io->Start_buf = (unsigned char *)buf;
+        io->Bufsize   = len;
+        io->Offset    = 0;
+
+        io->Next        = io->Start_buf;
+        io->sMark       = io->Start_buf;
+        io->eMark       = io->Start_buf;
+        io->End_buf     = io->Start_buf + len;
+        io->pMark       = NULL;
+        io->Termchar    = 0;
+        io->Eof_read    = 1;
+        io->been_called = 1;
+        io->Nl          = true;
+        io->sNl         = true;
+        io->eNl         = true;
+        io->Lmark       = io->Start_buf;
+        io->Lineno      = 1;
+}
+
+
+/**
+ * io_newstring_r
+ * ``````````````
+ * Prepare a string for reading, as io_newbuffer_r() does a buffer.
+ * The terminating NUL is not part of the input.
+ */
+void io_newstring_r(struct io_t *io, const char *str)
+{
+        io_newbuffer_r(io, str, strlen(str));
+}
+
+
+/**
+ * io_newahead_r
+ * `````````````
+ * Prepare a new input file for reading, on a thread of its own.
+ *
+ * @name : Path to the input file, or NULL for stdin.
+ * Return: As io_newfile_r().
+ *
+ * NOTES
+ * A reader thread reads the file a block at a time, AHEADSIZE characters,
+ * into a ring of NAHEAD blocks, and io_fillbuf() makes the next block
+ * the buffer instead of calling read(), so the scanner doesn't wait on
+ * the file as long as the thread keeps ahead. Only the text kept from
+ * the block before is copied, into the room in front of the block (see
+ * io_ahead_next()). If the thread can't be started, the file is read as
+ * usual. Link with -lpthread.
+ */
+int io_newahead_r(struct io_t *io, char *name)
+{
+        struct io_ahead *ah;
+        int fd;
+        int k;
+
+        if ((fd = io_newfile_r(io, name)) == -1)
+                return -1;
+
+        if (!(ah = calloc(1, sizeof(struct io_ahead)))) {
+                fprintf(stderr, "io_newahead: Out of memory.\n");
+                raise(SIGABRT);
+        }
+
+        for (k=0; k<NAHEAD; k++) {
+                if (!(ah->block[k] = malloc(AHEADROOM + AHEADSIZE + 1))) {
+                        fprintf(stderr, "io_newahead: Out of memory.\n");
+                        raise(SIGABRT);
+                }
+        }
+
+        ah->fd = fd;
+
+        pthread_mutex_init(&ah->lock, NULL);
+        pthread_cond_init(&ah->moved, NULL);
+
+        if (pthread_create(&ah->thread, NULL, io_ahead_run, ah) != 0) {
+                pthread_mutex_destroy(&ah->lock);
+                pthread_cond_destroy(&ah->moved);
+                for (k=0; k<NAHEAD; k++)
+                        free(ah->block[k]);
+                free(ah);
+                return fd;
+        }
+
+        io->Ahead = ah;
+
+        /* 
+         * The blocks are the buffer from now on. The room in front of the
+         * first one holds the newline io_advance() puts before the input.
+         */
+        free(io->Start_buf);
+
+        io->Start_buf = ah->block[0];
+        io->Bufsize   = AHEADROOM;
+        io->Next      = END;
+        io->sMark     = END;
+        io->eMark     = END;
+        io->End_buf   = END;
+        io->Lmark     = END;
+
+        return fd;
+}
+
+
 /******************************************************************************
  * Lexeme access and marker movement. 
  ******************************************************************************/
-unsigned char *io_text(void) 
+unsigned char *io_text_r(struct io_t *io)
+{
+        return io->sMark;
+}
+
+int io_length_r(struct io_t *io)
 {
-        return sMark;
+        return io->eMark - io->sMark;
 }
 
-int io_length(void) 
+int io_lineno_r(struct io_t *io)
 {
-        return eMark - sMark;
+        io_count(io, io->Next);
+
+        return io->Lineno;
 }
 
-int io_lineno(void) 
+long io_offset_r(struct io_t *io)
 {
-        return Lineno;
+        return io->Offset + (io->sMark - io->Start_buf);
 }
 
-unsigned char *io_ptext(void) 
+unsigned char *io_ptext_r(struct io_t *io)
 {
-        return pMark;
+        return io->pMark;
 }
 
-int io_plength(void) 
+int io_plength_r(struct io_t *io)
 {
-        return pLength;
+        return io->pLength;
 }
 
-int io_plineno(void) 
+int io_plineno_r(struct io_t *io)
 {
-        return pLineno;
+        return io->pLineno;
 }
 
 
-unsigned char *io_mark_start(void)
+unsigned char *io_mark_start_r(struct io_t *io)
 {
-        Mline = Lineno;
-        eMark = sMark = Next;
+        io->eMark = io->sMark = io->Next;
+        io->eNl   = io->sNl   = io->Nl;
 
-        return sMark;
+        return io->sMark;
 }
 
 
-unsigned char *io_mark_end(void)
+unsigned char *io_mark_end_r(struct io_t *io)
 {
-        Mline = Lineno;
-        eMark = Next;
+        io->eMark = io->Next;
+        io->eNl   = io->Nl;
 
-        return eMark;
+        return io->eMark;
 }
 
 
-unsigned char *io_move_start(void)
+unsigned char *io_move_start_r(struct io_t *io)
 {
-        if (sMark >= eMark)
+        /* The newline in front of a buffer in memory takes no room. */
+        if (io->sNl && !io->eNl) {
+                io->sNl = false;
+                return io->sMark;
+        }
+
+        if (io->sMark >= io->eMark)
                 return NULL;
         else
-                return ++sMark;
+                return ++io->sMark;
 }
 
 
-unsigned char *io_to_mark(void)
+unsigned char *io_to_mark_r(struct io_t *io)
 {
-        Lineno = Mline;
-        Next   = eMark;
+        io->Next   = io->eMark;
+        io->Nl     = io->eNl;
 
-        return Next;
+        return io->Next;
 }
 
 
 /**
- * io_mark_prev
- * ````````````
+ * io_mark_prev_r
+ * ``````````````
  * Set the pMark.
  *
  * CAVEAT
@@ -218,13 +935,13 @@ unsigned char *io_to_mark(void)
  * the token before last rather than the last one. If io_mark_prev()
  * is never called, pMark is just ignored, and you don't have to worry.
  */
-unsigned char *io_mark_prev(void)
+unsigned char *io_mark_prev_r(struct io_t *io)
 {
-        pMark   = sMark;
-        pLineno = Lineno;
-        pLength = eMark - sMark;
+        io->pMark   = io->sMark;
+        io->pLineno = io_lineno_r(io);
+        io->pLength = io->eMark - io->sMark;
 
-        return pMark;
+        return io->pMark;
 }
 
 
@@ -233,49 +950,51 @@ unsigned char *io_mark_prev(void)
  ******************************************************************************/
 
 /**
- * io_advance
- * ``````````
+ * io_advance_r
+ * ````````````
  * The real input function.
  *
  * NOTES
  * Returns the next character from input and advances past it. The buffer
  * is flushed if the current char is within MAXLOOK chars of the end of the
- * buffer. 0 is returned at EOF. -1 is returned if the buffer can't be flushed
- * because it's too full. In this case you can call io_flush(1) to do a
- * buffer flush but you'll lose the current lexeme as a consequence.
+ * buffer. 0 is returned at EOF. The buffer grows when a lexeme won't fit
+ * in it, so the -1 that used to mean it was too full isn't returned any
+ * more.
  */
-int io_advance(void)
+int io_advance_r(struct io_t *io)
 {
-        static int been_called = 0;
-
         /* 
          * Push a newline into the empty buffer so that the LeX start-of-line
          * anchor will work on the first input line.
          */
-        if (!been_called) {
-                Next = sMark = eMark = (END-1);
-                *Next = '\n';
-                --Lineno;
-                --Mline;
-                been_called = 1;
+        if (!io->been_called) {
+                io_alloc(io);
+                io->Next = io->sMark = io->eMark = END - 1;
+                *io->Next = '\n';
+                io->Offset = -(long)io->Bufsize;
+                --io->Lineno;
+                io->Lmark = io->Next;
+                io->been_called = 1;
+        }
+
+        if (io->Nl) {
+                io->Nl = false;
+                return '\n';
         }
 
         if (NO_MORE_CHARS)
                 return 0;
 
-        if (!Eof_read && (io_flush(false) < 0))
-                return -1;
-
-        if (*Next == '\n')
-                Lineno++;
+        if (!io->Eof_read)
+                io_flush_r(io, false);
 
-        return (*Next++);
+        return (*io->Next++);
 }
 
 
 /**
- * io_flush
- * ````````
+ * io_flush_r
+ * ``````````
  * Flush the input buffer.
  *
  * NOTES
@@ -296,63 +1015,52 @@ int io_advance(void)
  *
  *      |<------- shift_amt ------->|<---- copy_amt --->|
  *
- *      |<------------------------ BUFSIZE ---------------------->|
+ *      |<------------------------ Bufsize ---------------------->|
  *
  * Either the pMark or sMark (whichever is smaller) is used as the
  * leftmost edge of the buffer. None of the text to the right of the
- * mark will be lost. Return 1 if everything's ok, -1 if the buffer
- * is so full that it can't be flushed. 0 if we're at EOF.
+ * mark will be lost. If it would take up more than half of the buffer,
+ * the buffer is first doubled in size (as often as need be), so that a
+ * lexeme can be as long as memory allows, and every read is at least
+ * half a buffer. Return 1 if everything's ok, 0 if we're at EOF.
+ *
+ * The buffer is read until there are more than MAXLOOK characters past
+ * Next, or the end of the input, however short the reads of a pipe are.
  *
- * If "force" is true, a buffer flush is forced and the characters
- * already in the buffer are discarded. 
+ * If "force" is true, a buffer flush is forced even if Next isn't in
+ * the danger zone.
  *
  * CAVEAT
  * Don't call this function on a buffer that's been terminated 
  * by io_term().
  */
-int io_flush(bool force)
+int io_flush_r(struct io_t *io, bool force)
 {
         unsigned char *left_edge;
-        int copy_amt;
-        int shift_amt;
+        size_t copy_amt;
+        size_t size;
 
         if (NO_MORE_CHARS)
                 return 0;
 
-        if (Eof_read)
+        if (io->Eof_read)
                 return 1;
 
-        if (Next >= DANGER || force) {
-                left_edge = pMark ? min(sMark, pMark) : sMark;
-                shift_amt = left_edge - Start_buf;
-
-                /* Not enough room */
-                if (shift_amt < MAXLEX) {
-                        if (!force)
-                                return -1;
-
-                        /* Reset start to current character. */
-                        left_edge = io_mark_start();
-                        io_mark_prev();
-
-                        shift_amt = left_edge - Start_buf;
-                }
+        if (io->Next >= DANGER || force) {
+                left_edge = io->pMark ? min(io->sMark, io->pMark) : io->sMark;
+                copy_amt  = io->End_buf - left_edge;
 
-                copy_amt = End_buf - left_edge;
-                memcpy(Start_buf, left_edge, copy_amt);
+                /* The blocks read ahead have room for the text kept. */
+                if (!io->Ahead) {
+                        for (size = io->Bufsize; copy_amt + MAXLOOK > size / 2; size *= 2)
+                                ;
 
-                if (!(io_fillbuf(Start_buf + copy_amt))) {
-                        fprintf(stderr, "INTERNAL ERROR in io_flush: "
-                                        "Buffer full, can't read.\n");
-                        raise(SIGABRT);
+                        io_move(io, left_edge, size);
                 }
 
-                if (pMark)
-                        pMark -= shift_amt;
-
-                sMark -= shift_amt;
-                eMark -= shift_amt;
-                Next  -= shift_amt;
+                do {
+                        io_fillbuf_r(io, io->End_buf);
+                } while (!io->Eof_read && io->End_buf - io->Next <= MAXLOOK);
         }
 
         return 1;
@@ -360,56 +1068,55 @@ int io_flush(bool force)
 
 
 /**
- * io_fillbuf
- * ``````````
+ * io_fillbuf_r
+ * ````````````
  * Fill the input buffer from starting_at to the end of the buffer.
  *
  * NOTES
- * The input file is not clsed when EOF is reached. Buffers are read in
- * units of MAXLEX characters; it's an error if that many characters
- * cannot be read (0 is returned in this case).
- *
- * CAVEAT
- * This function assumes that the read function actually returns the
- * number of characters loaded into the buffer, and that the number will
- * be < need only when the last chunk of the file is read.
+ * The input file is not clsed when EOF is reached. A single read is
+ * made, for as much as there is room for; it may get less, from a pipe
+ * say, and it's only the end of the file when it gets nothing at all.
+ * A file read ahead isn't read into the buffer: the next block becomes
+ * the buffer, with the text before @starting_at kept in front of it.
+ * Return the number of characters read.
  */
-int io_fillbuf(unsigned char *starting_at)
+int io_fillbuf_r(struct io_t *io, unsigned char *starting_at)
 {
-        register unsigned need; // Number of bytes required from input.
-        register unsigned got;  // Number of bytes actually read.
+        size_t need;  // Number of bytes required from input.
+        ssize_t got;  // Number of bytes actually read.
 
-        need = ((END - starting_at) / MAXLEX) * MAXLEX;
+        if (io->Ahead) {
+                got = io_ahead_next(io, &starting_at);
+        } else {
+                need = END - starting_at;
 
-        if (need < 0) {
-                fprintf(stderr, "INTERNAL ERROR in io_fillbuf: "
-                                "Bad read-request starting addr.\n");
-                raise(SIGABRT);
-        }
+                if (need == 0)
+                        return 0;
 
-        if (need == 0) {
-                return 0;
+                do {
+                        got = read(io->Inp_file, starting_at, need);
+                } while (got == -1 && errno == EINTR);
         }
 
-        if ((got = read(Inp_file, starting_at, need)) == -1) {
+        if (got == -1) {
                 fprintf(stderr, "INTERNAL ERROR in io_fillbuf: "
                                 "Can't read input file.\n");
                 raise(SIGABRT);
         }
 
-        End_buf = starting_at + got;
+        io->End_buf = starting_at + got;
 
         /* We have reached end of file. */
-        if (got < need)
-                Eof_read = 1;
+        if (got == 0)
+                io->Eof_read = 1;
 
         return got;
 }
 
 
 /**
- * io_look
- * ```````
+ * io_look_r
+ * `````````
  * Return a lookahead character.
  *
  * @n    : The nth character of lookahead will be the one returned. 
@@ -417,22 +1124,25 @@ int io_fillbuf(unsigned char *starting_at)
  *         is past end of file, or 0 if nth character is past either 
  *         end of the buffer.
  */
-int io_look(int n)
+int io_look_r(struct io_t *io, int n)
 {
         unsigned char *p;
 
-        p = Next + (n-1);
+        if (io->Nl && n-- == 1)
+                return '\n';
+
+        p = io->Next + (n-1);
 
-        if (Eof_read && p >= End_buf)
+        if (io->Eof_read && p >= io->End_buf)
                 return EOF;
 
-        return (p < Start_buf || p >= End_buf) ? 0 : *p;
+        return (p < io->Start_buf || p >= io->End_buf) ? 0 : *p;
 }
 
 
 /**
- * io_pushback
- * ```````````
+ * io_pushback_r
+ * `````````````
  * Push characters back into the input.
  *
  * @n: Number of characters to be pushed back.
@@ -441,80 +1151,549 @@ int io_look(int n)
  * You can't push past the current sMark. You can push back characters
  * after the end of file has been encountered.
  */
-int io_pushback(int n)
+int io_pushback_r(struct io_t *io, int n)
 {
-        while (--n >= 0 && Next > sMark) {
-                if (*--Next == '\n' || !*Next)
-                        --Lineno;
-        }
+        while (--n >= 0 && io->Next > io->sMark)
+                --io->Next;
+
+        /* Back over the newline in front of a buffer in memory. */
+        if (n >= 0 && io->sNl && !io->Nl)
+                io->Nl = true;
 
-        if (Next < eMark) {
-                eMark = Next;
-                Mline = Lineno;
+        /* Uncount the newlines pushed back, while they're still there. */
+        if (io->Next < io->Lmark)
+                io_count(io, io->Next);
+
+        if (io->Next < io->eMark || (io->Nl && !io->eNl)) {
+                io->eMark = io->Next;
+                io->eNl   = io->Nl;
         }
 
-        return (Next > sMark);
+        return (io->Next > io->sMark);
 }
 
 /*
- * Support for '\0' terminated strings.
+ * Support for '\0' terminated strings, except in a mapped file or a
+ * buffer in memory.
  */
-void io_term(void)
+void io_term_r(struct io_t *io)
 {
-        Termchar = *Next;
-        *Next = '\0';
+        /* The lexeme is done with; count its newlines. */
+        io_count(io, io->Next);
+
+        if (io->Fixed)
+                return;
+
+        io->Termchar = *io->Next;
+        *io->Next = '\0';
 }
 
-void io_unterm(void)
+void io_unterm_r(struct io_t *io)
 {
-        if (Termchar) {
-                *Next = Termchar;
-                Termchar = 0;
+        if (io->Termchar) {
+                *io->Next = io->Termchar;
+                io->Termchar = 0;
         }
 }
 
-int io_input(void)
+int io_input_r(struct io_t *io)
 {
         int rval;
 
-        if (Termchar) {
-                io_unterm();
-                rval = io_advance();
-                io_mark_end();
-                io_term();
+        if (io->Termchar) {
+                io_unterm_r(io);
+                rval = io_advance_r(io);
+                io_mark_end_r(io);
+                io_term_r(io);
         } else {
-                rval = io_advance();
-                io_mark_end();
+                rval = io_advance_r(io);
+                io_mark_end_r(io);
         }
 
         return rval;
 }
 
-void io_unput(int c)
+void io_unput_r(struct io_t *io, int c)
 {
-        if (Termchar) {
-                io_unterm();
-                if (io_pushback(1)) {
-                        *Next = c;
+        if (io->Termchar) {
+                io_unterm_r(io);
+                if (io_pushback_r(io, 1)) {
+                        *io->Next = c;
                 }
-                io_term();
+                io_term_r(io);
         } else {
-                if (io_pushback(1)) {
-                        *Next = c;
+                if (io_pushback_r(io, 1) && !io->Fixed) {
+                        *io->Next = c;
+                }
+        }
+}
+
+int io_lookahead_r(struct io_t *io, int n)
+{
+        return (n == 1 && io->Termchar) ? io->Termchar : io_look_r(io, n);
+}
+
+int io_flushbuf_r(struct io_t *io)
+{
+        if (io->Termchar)
+                io_unterm_r(io);
+
+        return io_flush_r(io, true);
+}
+
+
+
+/******************************************************************************
+ * FAST-FORWARD
+ ******************************************************************************/
+
+/*
+ * The widest vector compare the target has. Without one, io_skip() falls
+ * back on comparing eight bytes at a time in a 64-bit word.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VEC              __m256i
+#define VEC_SIZE         32
+#define VEC_LOAD(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define VEC_SET1(c)      _mm256_set1_epi8((char)(c))
+#define VEC_EQ(a, b)     _mm256_cmpeq_epi8((a), (b))
+#define VEC_OR(a, b)     _mm256_or_si256((a), (b))
+#define VEC_ZERO()       _mm256_setzero_si256()
+#define VEC_MASK(v)      ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC              __m128i
+#define VEC_SIZE         16
+#define VEC_LOAD(p)      _mm_loadu_si128((const __m128i *)(p))
+#define VEC_SET1(c)      _mm_set1_epi8((char)(c))
+#define VEC_EQ(a, b)     _mm_cmpeq_epi8((a), (b))
+#define VEC_OR(a, b)     _mm_or_si128((a), (b))
+#define VEC_ZERO()       _mm_setzero_si128()
+#define VEC_MASK(v)      ((uint32_t)_mm_movemask_epi8(v))
+#else
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define LOWS  0x7F7F7F7F7F7F7F7FULL
+
+/* 0x80 in each byte of @w that is zero, and 0 in the others. */
+static inline uint64_t zero_bytes(uint64_t w)
+{
+        return ~(((w & LOWS) + LOWS) | w | LOWS);
+}
+#endif
+
+/* io_skipset() looks characters up in a table, sixteen at once. */
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+
+/******************************************************************************
+ * LINE NUMBERS
+ ******************************************************************************/
+
+/**
+ * io_lines
+ * ````````
+ * Count the newlines from @p up to @end, a vector at a time.
+ */
+static int io_lines(const unsigned char *p, const unsigned char *end)
+{
+        int n = 0;
+
+#ifdef VEC_SIZE
+        VEC newline = VEC_SET1('\n');
+
+        for (; p + VEC_SIZE <= end; p += VEC_SIZE)
+                n += __builtin_popcount(VEC_MASK(VEC_EQ(VEC_LOAD(p), newline)));
+#else
+        uint64_t w;
+
+        for (; p + 8 <= end; p += 8) {
+                memcpy(&w, p, 8);
+                n += __builtin_popcountll(zero_bytes(w ^ ('\n' * ONES)));
+        }
+#endif
+
+        for (; p < end; p++)
+                n += (*p == '\n');
+
+        return n;
+}
+
+
+/**
+ * io_count
+ * ````````
+ * Bring the line number up to date, at @to.
+ *
+ * NOTES
+ * The line number isn't kept a character at a time by io_advance().
+ * Lineno is the line number at Lmark, and the newlines from there to
+ * @to are counted all at once, when a lexeme is terminated or the line
+ * number is asked for. Scanning input that is mostly short tokens, that
+ * is a vector compare or two per token. @to is behind Lmark after a
+ * pushback, and the newlines in between are taken off.
+ */
+static void io_count(struct io_t *io, unsigned char *to)
+{
+        if (to > io->Lmark)
+                io->Lineno += io_lines(io->Lmark, to);
+        else if (to < io->Lmark)
+                io->Lineno -= io_lines(to, io->Lmark);
+
+        io->Lmark = to;
+}
+
+
+/**
+ * io_skip_r
+ * `````````
+ * Advance past input characters up to the next of a few escape
+ * characters.
+ *
+ * @esc  : The escape characters.
+ * @nesc : Number of escape characters, at most IO_ESCMAX.
+ * Return: Number of characters skipped.
+ *
+ * NOTES
+ * This is for DFA states that loop back to themselves on every other
+ * character, like the inside of a comment, which the scanner would
+ * otherwise run through one transition at a time.
+ *
+ * The skip stops short of the danger zone, so that the buffer never has
+ * to be flushed midway; the scanner goes on one character at a time
+ * from there, flushing as usual, and skips again. The newlines skipped
+ * are counted with the lexeme (see io_count()).
+ */
+int io_skip_r(struct io_t *io, const unsigned char *esc, int nesc)
+{
+        unsigned char *start = io->Next;
+        unsigned char *end;
+        unsigned char *p;
+        int k;
+
+        end = (io->Eof_read) ? io->End_buf : DANGER;
+
+        p = start;
+
+        /* The newline in front of a buffer in memory comes first. */
+        if (io->Nl)
+                return 0;
+
+#ifdef VEC_SIZE
+        {
+                VEC e[IO_ESCMAX];
+                VEC v;
+                VEC m;
+                uint32_t hit;
+
+                for (k=0; k<nesc; k++)
+                        e[k] = VEC_SET1(esc[k]);
+
+                for (; p + VEC_SIZE <= end; p += VEC_SIZE) {
+                        v = VEC_LOAD(p);
+                        m = VEC_ZERO();
+
+                        for (k=0; k<nesc; k++)
+                                m = VEC_OR(m, VEC_EQ(v, e[k]));
+
+                        hit = VEC_MASK(m);
+
+                        if (hit) {
+                                p += __builtin_ctz(hit);
+                                goto done;
+                        }
+                }
+        }
+#else
+        {
+                uint64_t e[IO_ESCMAX];
+                uint64_t w;
+                uint64_t m;
+
+                for (k=0; k<nesc; k++)
+                        e[k] = esc[k] * ONES;
+
+                for (; p + 8 <= end; p += 8) {
+                        memcpy(&w, p, 8);
+
+                        for (m=0, k=0; k<nesc; k++)
+                                m |= zero_bytes(w ^ e[k]);
+
+                        /* Finish the word a byte at a time. */
+                        if (m)
+                                break;
+                }
+        }
+#endif
+
+        for (; p < end; p++) {
+                for (k=0; k<nesc; k++) {
+                        if (*p == esc[k])
+                                goto done;
+                }
+        }
+
+done:
+        io->Next = p;
+
+        return p - start;
+}
+
+
+/**
+ * io_skipset_r
+ * ````````````
+ * Advance past input characters up to the next one in a set.
+ *
+ * @set  : The set, as a bitmap of 256 bits; character c is in it if
+ *         bit c % 8 of byte c / 8 is set.
+ * Return: Number of characters skipped.
+ *
+ * NOTES
+ * This is for skipping input that no rule can start on, so @set is
+ * usually large and io_skip() doesn't apply. With SSSE3 each vector of
+ * input is looked up in the bitmap by its nibbles, sixteen characters
+ * at once: the low nibble picks a byte of the bitmap for the characters
+ * with the high nibble in 0-7 or in 8-15, and the high nibble picks the
+ * bit. The nibble tables are kept in @io, and rebuilt only when @set
+ * changes.
+ *
+ * As in io_skip(), the skip stops short of the danger zone, and the
+ * newlines skipped are counted with the lexeme.
+ */
+int io_skipset_r(struct io_t *io, const unsigned char *set)
+{
+        unsigned char *start = io->Next;
+        unsigned char *end;
+        unsigned char *p;
+
+        end = (io->Eof_read) ? io->End_buf : DANGER;
+
+        p = start;
+
+        /* The newline in front of a buffer in memory comes first. */
+        if (io->Nl)
+                return 0;
+
+#ifdef __SSSE3__
+        {
+                __m128i tab0, tab1, bit, nib;
+                __m128i v, lo, hi, m;
+                uint32_t hit;
+                int c;
+
+                /* lo_tab[h / 8][l] has bit h % 8 set if (h << 4 | l) is in @set. */
+                if (set != io->cached) {
+                        memset(io->lo_tab, 0, sizeof(io->lo_tab));
+                        for (c=0; c<256; c++) {
+                                if (set[c / 8] & (1 << (c % 8)))
+                                        io->lo_tab[(c >> 4) / 8][c & 15] |= 1 << ((c >> 4) % 8);
+                        }
+                        io->cached = set;
+                }
+
+                tab0    = _mm_loadu_si128((const __m128i *)io->lo_tab[0]);
+                tab1    = _mm_loadu_si128((const __m128i *)io->lo_tab[1]);
+                bit     = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                        1, 2, 4, 8, 16, 32, 64, -128);
+                nib     = _mm_set1_epi8(0x0F);
+
+                for (; p + 16 <= end; p += 16) {
+                        v  = _mm_loadu_si128((const __m128i *)p);
+                        lo = _mm_and_si128(v, nib);
+                        hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+
+                        /* The bitmap byte for the half of the high nibble. */
+                        m = _mm_or_si128(_mm_andnot_si128(_mm_cmpgt_epi8(hi, _mm_set1_epi8(7)),
+                                                          _mm_shuffle_epi8(tab0, lo)),
+                                         _mm_and_si128(_mm_cmpgt_epi8(hi, _mm_set1_epi8(7)),
+                                                       _mm_shuffle_epi8(tab1, lo)));
+
+                        m   = _mm_and_si128(m, _mm_shuffle_epi8(bit, hi));
+                        hit = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(m, _mm_setzero_si128())) & 0xFFFF;
+
+                        if (hit) {
+                                p += __builtin_ctz(hit);
+                                goto done;
+                        }
                 }
         }
+#endif
+
+        for (; p < end && !(set[*p / 8] & (1 << (*p % 8))); p++)
+                ;
+
+#ifdef __SSSE3__
+done:
+#endif
+        io->Next = p;
+
+        return p - start;
+}
+
+
+/******************************************************************************
+ * SHARED CONTEXT
+ ******************************************************************************/
+
+/*
+ * The same functions, on the one context that the whole process shares.
+ */
+
+int io_newfile(char *name)
+{
+        return io_newfile_r(&Io_std, name);
+}
+
+int io_newmap(char *name)
+{
+        return io_newmap_r(&Io_std, name);
+}
+
+void io_newbuffer(const void *buf, size_t len)
+{
+        io_newbuffer_r(&Io_std, buf, len);
+}
+
+void io_newstring(const char *str)
+{
+        io_newstring_r(&Io_std, str);
+}
+
+int io_newahead(char *name)
+{
+        return io_newahead_r(&Io_std, name);
+}
+
+void io_bufsize(size_t size)
+{
+        io_bufsize_r(&Io_std, size);
+}
+
+unsigned char *io_text(void)
+{
+        return io_text_r(&Io_std);
+}
+
+int io_length(void)
+{
+        return io_length_r(&Io_std);
+}
+
+int io_lineno(void)
+{
+        return io_lineno_r(&Io_std);
+}
+
+long io_offset(void)
+{
+        return io_offset_r(&Io_std);
+}
+
+unsigned char *io_ptext(void)
+{
+        return io_ptext_r(&Io_std);
+}
+
+int io_plength(void)
+{
+        return io_plength_r(&Io_std);
+}
+
+int io_plineno(void)
+{
+        return io_plineno_r(&Io_std);
+}
+
+unsigned char *io_mark_start(void)
+{
+        return io_mark_start_r(&Io_std);
+}
+
+unsigned char *io_mark_end(void)
+{
+        return io_mark_end_r(&Io_std);
+}
+
+unsigned char *io_move_start(void)
+{
+        return io_move_start_r(&Io_std);
+}
+
+unsigned char *io_to_mark(void)
+{
+        return io_to_mark_r(&Io_std);
+}
+
+unsigned char *io_mark_prev(void)
+{
+        return io_mark_prev_r(&Io_std);
+}
+
+int io_advance(void)
+{
+        return io_advance_r(&Io_std);
+}
+
+int io_flush(bool force)
+{
+        return io_flush_r(&Io_std, force);
+}
+
+int io_fillbuf(unsigned char *starting_at)
+{
+        return io_fillbuf_r(&Io_std, starting_at);
+}
+
+int io_look(int n)
+{
+        return io_look_r(&Io_std, n);
+}
+
+int io_pushback(int n)
+{
+        return io_pushback_r(&Io_std, n);
+}
+
+void io_term(void)
+{
+        io_term_r(&Io_std);
+}
+
+void io_unterm(void)
+{
+        io_unterm_r(&Io_std);
+}
+
+int io_input(void)
+{
+        return io_input_r(&Io_std);
+}
+
+void io_unput(int c)
+{
+        io_unput_r(&Io_std, c);
 }
 
 int io_lookahead(int n)
 {
-        return (n == 1 && Termchar) ? Termchar : io_look(n);
+        return io_lookahead_r(&Io_std, n);
 }
 
 int io_flushbuf(void)
 {
-        if (Termchar)
-                io_unterm();
+        return io_flushbuf_r(&Io_std);
+}
 
-        return io_flush(true);
+int io_skip(const unsigned char *esc, int nesc)
+{
+        return io_skip_r(&Io_std, esc, nesc);
 }
 
+int io_skipset(const unsigned char *set)
+{
+        return io_skipset_r(&Io_std, set);
+}
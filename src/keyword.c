@@ -0,0 +1,459 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lib/debug.h"
+#include "lib/sparse.h"
+#include "nfa.h"
+#include "keyword.h"
+
+/******************************************************************************
+ * KEYWORDS
+ *
+ * A spec that lists its reserved words ahead of an identifier rule,
+ *
+ *      if                      return IF;
+ *      while                   return WHILE;
+ *      [a-zA-Z_][a-zA-Z0-9_]*  return ID;
+ *
+ * gets a chain of DFA states for every letter of every keyword. Since
+ * the identifier rule matches each of the keywords anyway, the keyword
+ * rules can be taken out of the NFA, and the identifier rule's action
+ * replaced with a lookup of the lexeme in a table of keywords:
+ *
+ *      switch (yy_keyword(yytext, yylen)) {
+ *      case 1: return IF;
+ *      case 2: return WHILE;
+ *      default: return ID;
+ *      }
+ *
+ * The result is the same as long as the identifier rule is the first
+ * rule after the keyword that matches it, and no rule before it does.
+ * Longest match is unaffected, since the identifier rule matches the
+ * keyword wherever the keyword rule did.
+ *
+ *****************************************************************************/
+
+
+/******************************************************************************
+ * HASHING
+ ******************************************************************************/
+
+/**
+ * kw_hash
+ * ```````
+ * Hash a string with a seed.
+ *
+ * @str  : String.
+ * @len  : Length of @str.
+ * @seed : Seed; each seed gives an unrelated hash function.
+ * Return: 32-bit hash.
+ *
+ * NOTES
+ * FNV-1a, finished with the MurmurHash3 mixer so that the low bits
+ * depend on every byte. The generated scanner has a copy of this
+ * function, and the two must agree.
+ */
+uint32_t kw_hash(unsigned char *str, int len, uint32_t seed)
+{
+        uint32_t h = 2166136261u ^ seed;
+
+        while (len--) {
+                h ^= *str++;
+                h *= 16777619u;
+        }
+
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+
+        return h;
+}
+
+
+/* Order buckets by size, largest first, in kw_place(). */
+static int *bucket_first;
+
+static int bucket_cmp(const void *a, const void *b)
+{
+        int x = *(const int *)a;
+        int y = *(const int *)b;
+
+        return (bucket_first[y+1] - bucket_first[y]) - (bucket_first[x+1] - bucket_first[x]);
+}
+
+
+/**
+ * kw_place
+ * ````````
+ * Try to find a displacement for every bucket of the keyword table.
+ *
+ * @kw   : Keyword set, with @nbuckets and @nslots set.
+ * Return: true if every keyword got a slot of its own.
+ *
+ * NOTES
+ * The largest buckets are placed first, while the table is emptiest,
+ * as in "hash, displace, and compress" (Belazzougui et al.).
+ */
+static bool kw_place(struct kwset_t *kw)
+{
+        int *bucket; // Bucket of each keyword.
+        int *member; // Keywords, grouped by bucket.
+        int *order;  // Buckets, largest first.
+        int *placed; // Slots taken by the bucket being placed.
+        int *next;   // Next free place in @member of each bucket.
+        bool fit = true;
+        int b, d, i, j, k, s;
+
+        bucket       = malloc(kw->n * sizeof(int));
+        member       = malloc(kw->n * sizeof(int));
+        order        = malloc(kw->nbuckets * sizeof(int));
+        placed       = malloc(kw->n * sizeof(int));
+        next         = malloc(kw->nbuckets * sizeof(int));
+        bucket_first = calloc(kw->nbuckets + 1, sizeof(int));
+
+        if (!bucket || !member || !order || !placed || !next || !bucket_first)
+                halt(SIGABRT, "kw_place: Out of memory.\n");
+
+        /* Group the keywords by bucket, as in a counting sort. */
+        for (i=0; i<kw->n; i++) {
+                bucket[i] = kw_hash(kw->kw[i].str, kw->kw[i].len, 0) % kw->nbuckets;
+                bucket_first[bucket[i] + 1]++;
+        }
+
+        for (b=0; b<kw->nbuckets; b++) {
+                bucket_first[b+1] += bucket_first[b];
+                next[b] = bucket_first[b];
+        }
+
+        for (i=0; i<kw->n; i++)
+                member[next[bucket[i]]++] = i;
+
+        for (b=0; b<kw->nbuckets; b++)
+                order[b] = b;
+
+        qsort(order, kw->nbuckets, sizeof(int), bucket_cmp);
+
+        for (s=0; s<kw->nslots; s++)
+                kw->slot[s] = -1;
+
+        for (b=0; b<kw->nbuckets; b++)
+                kw->disp[b] = 0;
+
+        for (j=0; fit && j<kw->nbuckets; j++) {
+                b = order[j];
+
+                if (bucket_first[b] == bucket_first[b+1])
+                        break;
+
+                for (fit=false, d=1; !fit && d<(1 << 16); d++) {
+                        for (fit=true, k=0, i=bucket_first[b]; fit && i<bucket_first[b+1]; i++) {
+                                s = kw_hash(kw->kw[member[i]].str, kw->kw[member[i]].len, d) % kw->nslots;
+
+                                if (kw->slot[s] != -1) {
+                                        fit = false;
+                                } else {
+                                        kw->slot[s] = member[i];
+                                        placed[k++] = s;
+                                }
+                        }
+
+                        /* Take back a partial placement. */
+                        if (!fit) {
+                                while (k--)
+                                        kw->slot[placed[k]] = -1;
+                        } else {
+                                kw->disp[b] = d;
+                        }
+                }
+        }
+
+        free(bucket);
+        free(member);
+        free(order);
+        free(placed);
+        free(next);
+        free(bucket_first);
+
+        return fit;
+}
+
+
+/**
+ * kw_table
+ * ````````
+ * Build the perfect hash table of a keyword set.
+ *
+ * @kw   : Keyword set.
+ * Return: Nothing.
+ *
+ * NOTES
+ * With four keywords to a bucket and the table 80% full, placement
+ * nearly always succeeds at once; if it doesn't, the table is grown
+ * and placement starts over.
+ */
+static void kw_table(struct kwset_t *kw)
+{
+        kw->nbuckets = kw->n / 4 + 1;
+        kw->nslots   = kw->n + kw->n / 4 + 1;
+
+        while (1) {
+                kw->disp = realloc(kw->disp, kw->nbuckets * sizeof(int));
+                kw->slot = realloc(kw->slot, kw->nslots * sizeof(int));
+
+                if (!kw->disp || !kw->slot)
+                        halt(SIGABRT, "kw_table: Out of memory.\n");
+
+                if (kw_place(kw))
+                        break;
+
+                kw->nslots += kw->nslots / 2;
+        }
+}
+
+
+/******************************************************************************
+ * EXTRACTION
+ ******************************************************************************/
+
+/**
+ * literal
+ * ```````
+ * Check whether a rule is a plain string, and if so, spell it out.
+ *
+ * @start: Start state of the rule.
+ * @len  : Length of the string (output).
+ * Return: The string, or NULL if the rule is not a plain string.
+ *
+ * NOTES
+ * A plain string is a chain of states with literal edges ending in an
+ * unanchored accepting state. Anchored rules are never plain strings,
+ * since their anchors are edges of their own.
+ */
+static unsigned char *literal(struct nfa_state *start, int *len)
+{
+        unsigned char *str;
+        struct nfa_state *p;
+        int n;
+
+        for (n=0, p=start; p->edge >= 0 && p->next; p=p->next)
+                n++;
+
+        if (n == 0 || p->edge != EPSILON || p->next || p->next2 || !p->accept || p->anchor)
+                return NULL;
+
+        if (!(str = malloc(n)))
+                halt(SIGABRT, "literal: Out of memory.\n");
+
+        for (n=0, p=start; p->edge >= 0; p=p->next)
+                str[n++] = p->edge;
+
+        *len = n;
+
+        return str;
+}
+
+
+/**
+ * unlink_rule
+ * ```````````
+ * Strip the edges and the action from the states of a plain string rule,
+ * so that nothing that walks the state array sees them.
+ *
+ * @nfa  : NFA object.
+ * @start: Start state of the rule.
+ * Return: Nothing.
+ *
+ * NOTES
+ * cat_expr() joins terms by copying one state over another, so the same
+ * state can also live under another id; both copies are stripped.
+ */
+static void unlink_rule(struct nfa_t *nfa, struct nfa_state *start)
+{
+        struct nfa_state *p;
+        struct nfa_state *next;
+
+        for (p=start; p; p=next) {
+                next = p->next;
+
+                p->edge   = EPSILON;
+                p->next   = NULL;
+                p->accept = NULL;
+
+                nfa->state[p->id]->edge   = EPSILON;
+                nfa->state[p->id]->next   = NULL;
+                nfa->state[p->id]->accept = NULL;
+        }
+}
+
+
+/**
+ * dispatch
+ * ````````
+ * Replace the action of a general rule with a switch on the keyword the
+ * lexeme is, falling back to the rule's own action.
+ *
+ * @kw   : Keyword set.
+ * @owner: Accepting state of the general rule.
+ * Return: Nothing.
+ *
+ * NOTES
+ * The cases are indented to sit in the switch printed by pdriver().
+ */
+static void dispatch(struct kwset_t *kw, struct nfa_state *owner)
+{
+        char *action;
+        size_t size;
+        int n;
+        int i;
+
+        size = strlen(owner->accept) + 128;
+
+        for (i=0; i<kw->n; i++) {
+                if (kw->kw[i].owner == owner)
+                        size += strlen(kw->kw[i].accept) + 64;
+        }
+
+        if (!(action = malloc(size)))
+                halt(SIGABRT, "dispatch: Out of memory.\n");
+
+        n = sprintf(action, "switch (yy_keyword(yytext, yylen)) {\n");
+
+        for (i=0; i<kw->n; i++) {
+                if (kw->kw[i].owner == owner) {
+                        n += sprintf(action + n, "\t\t\t\t\t\tcase %d:\n"
+                                                 "\t\t\t\t\t\t\t%s\n"
+                                                 "\t\t\t\t\t\t\tbreak;\n",
+                                                 kw->kw[i].rule, kw->kw[i].accept);
+                }
+        }
+
+        sprintf(action + n, "\t\t\t\t\t\tdefault:\n"
+                            "\t\t\t\t\t\t\t%s\n"
+                            "\t\t\t\t\t\t\tbreak;\n"
+                            "\t\t\t\t\t\t}", owner->accept);
+
+        owner->accept = action;
+}
+
+
+/**
+ * keywords
+ * ````````
+ * Take the keyword rules out of a list of rules.
+ *
+ * @nfa   : NFA object.
+ * @rule  : Start state of each rule, in order; keyword rules are set
+ *          to NULL.
+ * @nrules: Number of rules.
+ * Return : The keywords, with their perfect hash table.
+ *
+ * NOTES
+ * A plain string rule is a keyword if no rule before it matches the
+ * string, and the first rule after it that does is not itself a plain
+ * string. Plain strings are compared directly; other rules are run on
+ * the string with nfa_match().
+ */
+struct kwset_t *keywords(struct nfa_t *nfa, struct nfa_state **rule, int nrules)
+{
+        struct kwset_t *kw;
+        struct sparse_t *cur;
+        struct sparse_t *next;
+        struct nfa_state *owner;
+        struct nfa_state *p;
+        unsigned char **str; // String of each plain string rule, else NULL.
+        int *len;
+        bool shadowed;
+        int i;
+        int j;
+        int k;
+
+        kw   = calloc(1, sizeof(struct kwset_t));
+        str  = calloc(nrules, sizeof(unsigned char *));
+        len  = calloc(nrules, sizeof(int));
+        cur  = new_sparse(nfa->n);
+        next = new_sparse(nfa->n);
+
+        if (!kw || !str || !len)
+                halt(SIGABRT, "keywords: Out of memory.\n");
+
+        #define MATCHES(j, s, n) \
+                ((str[j]) ? (len[j] == (n) && !memcmp(str[j], (s), (n))) \
+                          : nfa_match(nfa, rule[j], (s), (n), cur, next) != NULL)
+
+        for (i=0; i<nrules; i++)
+                str[i] = literal(rule[i], &len[i]);
+
+        for (i=0; i<nrules; i++) {
+                if (!str[i])
+                        continue;
+
+                for (shadowed=false, j=0; !shadowed && j<i; j++)
+                        shadowed = MATCHES(j, str[i], len[i]);
+
+                if (shadowed)
+                        continue;
+
+                for (j=i+1; j<nrules && !MATCHES(j, str[i], len[i]); j++)
+                        ;
+
+                if (j == nrules || str[j])
+                        continue;
+
+                owner = nfa_match(nfa, rule[j], str[i], len[i], cur, next);
+
+                if (owner->anchor)
+                        continue;
+
+                if (kw->n == kw->max) {
+                        kw->max = (kw->max) ? kw->max * 2 : 64;
+                        if (!(kw->kw = realloc(kw->kw, kw->max * sizeof(struct keyword_t))))
+                                halt(SIGABRT, "keywords: Out of memory.\n");
+                }
+
+                /* The action is on the last state of the chain. */
+                for (p=rule[i]; p->next; p=p->next)
+                        ;
+
+                kw->kw[kw->n].str    = str[i];
+                kw->kw[kw->n].len    = len[i];
+                kw->kw[kw->n].rule   = i + 1;
+                kw->kw[kw->n].accept = p->accept;
+                kw->kw[kw->n].owner  = owner;
+                kw->n++;
+        }
+
+        #undef MATCHES
+
+        /* Only now, since every rule is matched against every string. */
+        for (i=0; i<kw->n; i++) {
+                j = kw->kw[i].rule - 1;
+
+                unlink_rule(nfa, rule[j]);
+                rule[j] = NULL;
+                str[j]  = NULL;
+
+                /* Each general rule gets its switch once. */
+                for (k=0; k<i && kw->kw[k].owner != kw->kw[i].owner; k++)
+                        ;
+
+                if (k == i)
+                        dispatch(kw, kw->kw[i].owner);
+        }
+
+        if (kw->n > 0)
+                kw_table(kw);
+
+        for (i=0; i<nrules; i++)
+                free(str[i]);
+
+        free(str);
+        free(len);
+        del_sparse(cur);
+        del_sparse(next);
+
+        return kw;
+}
@@ -0,0 +1,56 @@
+#ifndef _KEYWORD_H
+#define _KEYWORD_H
+
+#include <stdint.h>
+
+#include "nfa.h"
+
+
+/******************************************************************************
+ * KEYWORD TYPES
+ ******************************************************************************/
+
+/**
+ * keyword_t
+ * `````````
+ * A rule whose pattern is a plain string, and which was taken out of
+ * the NFA because a later, more general rule matches the same string.
+ */
+struct keyword_t {
+        unsigned char *str;      // The string, not terminated.
+        int len;                 // Length of @str.
+        int rule;                // Number of the rule, counting from 1.
+        char *accept;            // Action of the rule.
+        struct nfa_state *owner; // Accepting state of the general rule.
+};
+
+
+/**
+ * kwset_t
+ * ```````
+ * The keywords of a spec, and a perfect hash table to find them in.
+ *
+ * A string is in bucket hash(0) % nbuckets, and bucket b is displaced
+ * into slot hash(disp[b]) % nslots, where the displacements are chosen
+ * so that no two keywords land in the same slot.
+ */
+struct kwset_t {
+        struct keyword_t *kw; // Keywords, in rule order.
+        int n;                // Number of keywords.
+        int max;              // Allocated size of @kw.
+        int *disp;            // Hash seed of each bucket.
+        int nbuckets;         // Number of buckets.
+        int *slot;            // Keyword in each slot, or -1 if empty.
+        int nslots;           // Size of the table.
+};
+
+
+/******************************************************************************
+ * KEYWORD FUNCTIONS
+ ******************************************************************************/
+
+struct kwset_t *keywords(struct nfa_t *nfa, struct nfa_state **rule, int nrules);
+uint32_t         kw_hash(unsigned char *str, int len, uint32_t seed);
+
+
+#endif
@@ -10,6 +10,8 @@
 #include "nfa.h"
 #include "main.h"
 #include "macro.h"
+#include "utf8.h"
+#include "keyword.h"
 #include "lex.h"
 
 /******************************************************************************
@@ -47,7 +49,7 @@ void          cat_expr(struct lexer_t *lex, struct nfa_state **startp, struct nf
 int       first_in_cat(struct lexer_t *lex);
 void           closure(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **endp);
 void              term(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **endp);
-void            dodash(struct lexer_t *lex, struct set_t *set);
+void            dodash(struct lexer_t *lex, struct ccl_t *ccl);
 
 
 /******************************************************************************
@@ -60,12 +62,12 @@ void            dodash(struct lexer_t *lex, struct set_t *set);
  * `````````
  * Allocates and initializes the lexer object.
  *
- * @input       : Stream pointer to input file to be lexed.
- * @max_linesize: Maximum number of characters per line.
- * @max_states  : Maximum number of NFA states.
- * Return       : Pointer to a lexer object.
+ * @input     : Stream pointer to input file to be lexed.
+ * @max_states: Initial size of the NFA state array.
+ * @utf8      : Read the expressions as UTF-8 text.
+ * Return     : Pointer to a lexer object.
  */
-struct lexer_t *new_lexer(FILE *input, int max_linesize, int max_states)
+struct lexer_t *new_lexer(FILE *input, int max_states, bool utf8)
 {
         struct lexer_t *new;
         new = malloc(sizeof(struct lexer_t)); 
@@ -78,8 +80,12 @@ struct lexer_t *new_lexer(FILE *input, int max_linesize, int max_states)
 
         /* Create the NFA object and line buffer. */
         new->nfa  = new_nfa(max_states);
-        new->line = calloc(max_linesize, sizeof(char));
-        new->size = max_linesize;
+        new->buf  = NULL;
+        new->size = 0;
+        new->line = NULL;
+        new->utf8 = utf8;
+        new->keywords = false;
+        new->nrules   = 0;
 
         /* Load the first token. */
         new->token = EOS;
@@ -97,22 +103,49 @@ struct lexer_t *new_lexer(FILE *input, int max_linesize, int max_states)
  * machine (entry)
  * ```````
  * Build the NFA state machine.
+ *
+ * NOTES
+ * The rules are parsed first and joined under the start state after,
+ * so that keyword rules can be left out. Only the ids of the accepting
+ * states order the rules, and those follow the order of the spec.
  */
 void machine(struct lexer_t *lex)
 {
         struct nfa_state *state;
+        struct nfa_state **rules = NULL;
+        int nrules = 0;
+        int max = 0;
+        int i;
 
         __ENTER;
 
-        state       = new_nfa_state(lex->nfa);
-        state->next = rule(lex);
+        state = new_nfa_state(lex->nfa);
+
+        do {
+                if (nrules == max) {
+                        max = (max) ? max * 2 : 64;
+                        if (!(rules = realloc(rules, max * sizeof(struct nfa_state *))))
+                                parse_err(lex, E_MEM);
+                }
+                rules[nrules++] = rule(lex);
+        } while (lex->token != END_OF_INPUT);
+
+        if (lex->keywords)
+                lex->nfa->kw = keywords(lex->nfa, rules, nrules);
 
-        while (lex->token != END_OF_INPUT) {
-                state->next2 = new_nfa_state(lex->nfa);
-                state        = state->next2;
-                state->next  = rule(lex);
+        for (i=0; i<nrules; i++) {
+                if (!rules[i])
+                        continue;
+
+                if (state->next) {
+                        state->next2 = new_nfa_state(lex->nfa);
+                        state        = state->next2;
+                }
+                state->next = rules[i];
         }
 
+        free(rules);
+
         __LEAVE;
 }
 
@@ -122,6 +155,58 @@ void machine(struct lexer_t *lex)
  ******************************************************************************/
 
 
+/**
+ * is_unicode
+ * ``````````
+ * In UTF-8 mode, check whether the input is at a code point that needs
+ * to be decoded by unicode(): a multi-byte sequence, or a \u or \U
+ * escape.
+ */
+static inline bool is_unicode(struct lexer_t *lex)
+{
+        unsigned char *p = (unsigned char *)lex->position;
+
+        return (p[0] >= UTF8_SELF)
+            || (p[0] == '\\' && (p[1] == 'u' || p[1] == 'U'));
+}
+
+
+/**
+ * unicode
+ * ```````
+ * Read one code point, written either as a literal UTF-8 sequence or
+ * as an escape of exactly four (\uXXXX) or eight (\UXXXXXXXX) hex digits.
+ *
+ * @lex  : The lexer object.
+ * Return: The code point.
+ */
+static int unicode(struct lexer_t *lex)
+{
+        int digits;
+        int c;
+
+        if (*lex->position != '\\') {
+                if ((c = utf8_decode(&lex->position)) == -1)
+                        parse_err(lex, E_UTF8);
+                return c;
+        }
+
+        digits = (lex->position[1] == 'u') ? 4 : 8;
+        lex->position += 2;
+
+        for (c=0; digits>0; digits--, lex->position++) {
+                if (!isxdigit(*lex->position) || c > (UTF8_MAX >> 4))
+                        parse_err(lex, E_UTF8);
+                c = (c << 4) | hex2bin(*lex->position);
+        }
+
+        if (c > UTF8_MAX || (c >= SURROGATE_LO && c <= SURROGATE_HI))
+                parse_err(lex, E_UTF8);
+
+        return c;
+}
+
+
 /**
  * advance
  * ```````
@@ -162,10 +247,11 @@ enum token_t advance(struct lexer_t *lex)
 
                 /* Loop until a non-blank line is read. */
 	        do {
-	                if (!(lex->position = fgets(lex->line, lex->size, lex->input_file))) {
+	                if (getstr(&lex->buf, &lex->size, lex->input_file) == -1) {
 		                lex->token = END_OF_INPUT;
 		                goto exit;
                         }
+                        lex->position = lex->buf;
 	                while (isspace(*lex->position))
 		                lex->position++;
 
@@ -235,21 +321,26 @@ enum token_t advance(struct lexer_t *lex)
 	                lex->lexeme = '\0';
 	                goto exit;
 	        }
-	        lex->lexeme = esc(&lex->position);
+                if (lex->utf8 && is_unicode(lex))
+                        lex->lexeme = unicode(lex);
+                else
+	                lex->lexeme = esc(&lex->position);
         } else {
 	        if (saw_escape && lex->position[1] == '"') {
                 /* Skip the escaped character. */
 	                lex->position += 2;	
 	                lex->lexeme = '"';
+	        } else if (lex->utf8 && is_unicode(lex)) {
+                        lex->lexeme = unicode(lex);
 	        } else {
-	                lex->lexeme = *lex->position++;
+	                lex->lexeme = (unsigned char)*lex->position++;
                 }
         }
 
-        lex->token = (in_quote || saw_escape) ? L : TOKEN_MAP[lex->lexeme];
+        lex->token = (in_quote || saw_escape) ? L : token_of(lex->lexeme);
 
         #if LEXER_DEBUG
-        printf("lexeme: %c token: %d\n", lex->lexeme, TOKEN_MAP[lex->lexeme]);
+        printf("lexeme: %c token: %d\n", lex->lexeme, token_of(lex->lexeme));
         #endif
 
         exit:
@@ -302,7 +393,7 @@ struct nfa_state *rule(struct lexer_t *lex)
                 end->next = new_nfa_state(lex->nfa);
                 end->edge = CCL;
 
-                if (!(end->bitset = new_set(1024)))
+                if (!(end->bitset = new_set(MAX_CHARS)))
                         parse_err(lex, E_MEM);
 
                 set_add(end->bitset, '\n');
@@ -318,6 +409,7 @@ struct nfa_state *rule(struct lexer_t *lex)
 
         end->accept = save(lex->position);
         end->anchor = anchor;
+        end->rule   = ++lex->nrules;
         advance(lex); // Skip past EOS
 
         __LEAVE;
@@ -510,11 +602,18 @@ void closure(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **
  *
  * The [] is nonstandard. It matches a space, tab, formfeed, or newline,
  * but not a carriage return (\r). All of these are single nodes in the
- * NFA.
+ * NFA, except in UTF-8 mode, where a class or literal containing code
+ * points past 0x7F is expanded by utf8_machine() or utf8_literal().
+ *
+ * A negated class (and the dot) is the complement of its members and
+ * the newline, taken over the bytes, or in UTF-8 mode over the Unicode
+ * scalar values.
  */
 void term(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **endp)
 {
         struct nfa_state *start;
+        struct ccl_t *ccl;
+        int i;
         int c;
 
         __ENTER;
@@ -526,44 +625,62 @@ void term(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **end
 	                advance(lex);
 	        else
                         parse_err(lex, E_PAREN);
-        } else {
-	        *startp = start = new_nfa_state(lex->nfa);
-	        *endp   = start->next = new_nfa_state(lex->nfa);
 
-                if (!(lex->token == ANY || lex->token == CCL_START)) {
+        } else if (!(lex->token == ANY || lex->token == CCL_START)) {
+                if (lex->utf8 && lex->lexeme >= UTF8_SELF) {
+                        utf8_literal(lex->nfa, lex->lexeme, startp, endp);
+                } else {
+                        *startp = start = new_nfa_state(lex->nfa);
+                        *endp   = start->next = new_nfa_state(lex->nfa);
                         start->edge = lex->lexeme;
+                }
+                advance(lex);
+
+        } else {
+                ccl = new_ccl();
+
+                /* dot (.) */
+                if (lex->token == ANY) {
+                        ccl_add(ccl, '\n', '\n');
+                        ccl_complement(ccl, (lex->utf8) ? UTF8_MAX : MAX_CHARS-1);
+                } else {
                         advance(lex);
+                        /* Negative character class */
+                        if (lex->token == AT_BOL) {
+                                advance(lex);
+
+                                if (lex->token != CCL_END)
+                                        dodash(lex, ccl);
+                                else // [^]
+                                        ccl_add(ccl, 0, ' ');
+
+                                /* Don't include \n in class */
+                                ccl_add(ccl, '\n', '\n');
+
+                                ccl_complement(ccl, (lex->utf8) ? UTF8_MAX : MAX_CHARS-1);
+
+                        } else if (lex->token != CCL_END) {
+                                dodash(lex, ccl);
+                        } else { // []
+                                ccl_add(ccl, 0, ' ');
+                        }
+                }
+
+                if (lex->utf8) {
+                        utf8_machine(lex->nfa, ccl, startp, endp);
                 } else {
+                        *startp = start = new_nfa_state(lex->nfa);
+                        *endp   = start->next = new_nfa_state(lex->nfa);
                         start->edge = CCL;
 
-                        if (!(start->bitset = new_set(1024)))
-                                parse_err(lex, E_MEM);
-
-                        /* dot (.) */
-                        if (lex->token == ANY) {
-                                set_add(start->bitset, '\n');
-                                set_complement(start->bitset);
-                        } else {
-                                advance(lex);
-                                /* Negative character class */
-                                if (lex->token == AT_BOL) {
-                                        advance(lex);
-
-                                        /* Don't include \n in class */
-                                        set_add(start->bitset, '\n');
-
-                                        set_complement(start->bitset);
-                                }
-
-                                if (lex->token != CCL_END) {
-                                        dodash(lex, start->bitset);
-                                } else { // [] or [^]
-                                        for (c=0; c<=' '; ++c)
-                                                set_add(start->bitset, c);
-                                }
+                        for (i=0; i<ccl->n; i++) {
+                                for (c=ccl->range[i].lo; c<=ccl->range[i].hi && c<MAX_CHARS; c++)
+                                        set_add(start->bitset, c);
                         }
-                        advance(lex);
                 }
+
+                del_ccl(ccl);
+                advance(lex);
         }
 
         __LEAVE;
@@ -571,7 +688,7 @@ void term(struct lexer_t *lex, struct nfa_state **startp, struct nfa_state **end
 
 
 
-void dodash(struct lexer_t *lex, struct set_t *set)
+void dodash(struct lexer_t *lex, struct ccl_t *ccl)
 {
         register int first = 0;
 
@@ -579,28 +696,25 @@ void dodash(struct lexer_t *lex, struct set_t *set)
 
         /* Treat [-...] as a literal dash, but print a warning. */
         if (lex->token == DASH) {		
-	        set_add(set, lex->lexeme);
+	        ccl_add(ccl, lex->lexeme, lex->lexeme);
 	        advance(lex);
         }
 
         for (; lex->token != EOS && lex->token != CCL_END; advance(lex)) {
 	        if (lex->token != DASH) {
 	                first = lex->lexeme;
-	                set_add(set, lex->lexeme);
+	                ccl_add(ccl, lex->lexeme, lex->lexeme);
                 /* Looking at a dash */
 	        } else {
 	                advance(lex);
                         /* Treat [...-] as literal */
 	                if (lex->token == CCL_END) {
-		                set_add(set, '-');
+		                ccl_add(ccl, '-', '-');
 	                } else {
-		                for (; first<=lex->lexeme; first++)
-		                        set_add(set, first);
+		                ccl_add(ccl, first, lex->lexeme);
                         }
 	        }
 	}
 
         __LEAVE;
 }
-
-
@@ -1,6 +1,8 @@
 #ifndef _LEXER_H
 #define _LEXER_H
 
+#include <stdbool.h>
+
 #include "main.h"
 #include "lib/set.h"
 
@@ -9,6 +11,12 @@
  * CONSTANTS AND CODED CHARACTERS
  ******************************************************************************/
 
+/*
+ * Size of the input alphabet. Every byte value is a character,
+ * so this is also the widest a DFA's transition table can be.
+ */
+#define MAX_CHARS 256 
+
 /* 
  * Non-character edge values 
  */
@@ -64,6 +72,9 @@ enum token_t {
  * index into this table, which will map it to one of the token_t
  * values defined above, telling the parser what the token type is
  * for the particular symbol it has just read.
+ *
+ * Only 7-bit symbols are listed; anything past the end of the table
+ * (including all 8-bit bytes) is a literal. See token_of().
  */
 static enum token_t TOKEN_MAP[] = {
         //  ^@  ^A  ^B  ^C  ^D  ^E  ^F  ^G  ^H  ^I  ^J  ^K  ^L  ^M  ^N	
@@ -92,6 +103,11 @@ static enum token_t TOKEN_MAP[] = {
             OPEN_CURLY,  OR,  CLOSE_CURLY, L
 };
 
+static inline enum token_t token_of(int lexeme)
+{
+        return (lexeme < sizeof(TOKEN_MAP)/sizeof(*TOKEN_MAP)) ? TOKEN_MAP[lexeme] : L;
+}
+
 
 /******************************************************************************
  * LEXER OBJECT
@@ -110,11 +126,15 @@ static enum token_t TOKEN_MAP[] = {
  */
 struct lexer_t {
         enum token_t token;
-        size_t size;
         int  lexeme;
         FILE *input_file;
+        char *buf;              // Line buffer, grown by getstr().
+        size_t size;            // Allocated size of @buf.
         char *position;
         char *line;
+        bool utf8;              // Literals and classes are UTF-8 code points.
+        bool keywords;          // Take keyword rules out, see keywords().
+        int  nrules;            // Number of rules parsed so far.
         struct nfa_t *nfa;
 };
 
@@ -124,7 +144,7 @@ struct lexer_t {
  ******************************************************************************/
 
 
-struct lexer_t *new_lexer(FILE *input, int max_linesize, int max_states);
+struct lexer_t *new_lexer(FILE *input, int max_states, bool utf8);
 void              machine(struct lexer_t *lex);
 
 
@@ -147,7 +167,8 @@ enum lex_err {
         E_NEWLINE,	// Newline in quoted string
         E_BADMAC,	// Missing } in macro expansion
         E_NOMAC,	// Macro doesn't exist
-        E_MACDEPTH      // Macro expansions nested too deeply
+        E_MACDEPTH,     // Macro expansions nested too deeply
+        E_UTF8          // Malformed UTF-8 or code point escape
 };
 
 
@@ -165,7 +186,8 @@ static char *lex_err_msg[] = {
         "Newline in quoted string, use \\n to get newline into expression",
         "Missing } in macro expansion",
         "Macro doesn't exist",
-        "Macro expansions nested too deeply"
+        "Macro expansions nested too deeply",
+        "Malformed UTF-8 sequence or \\u escape"
 };
 
 
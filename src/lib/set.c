@@ -309,6 +309,36 @@ int next_member(struct set_t *set)
 }
 
 
+/**
+ * set_hash
+ * ````````
+ * Compute a 64-bit hash of the members of a set.
+ *
+ * @set  : Pointer to a set.
+ * Return: FNV-1a hash of the bitmap.
+ *
+ * NOTE
+ * Trailing empty words are not hashed, so that equivalent sets of
+ * different sizes hash to the same value, matching set_test().
+ */
+uint64_t set_hash(struct set_t *set)
+{
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        int n;
+        int i;
+
+        for (n = set->nwords; n > 0 && set->map[n-1] == 0; n--)
+                ;
+
+        for (i=0; i<n; i++) {
+                hash ^= (unsigned char)set->map[i];
+                hash *= 0x100000001b3ULL;
+        }
+
+        return hash;
+}
+
+
 /**
  * print_set
  * `````````
@@ -358,7 +388,8 @@ void print_set(struct set_t *set)
  *
  *
  * NOTE
- * The smaller set is made larger if the two sets are different sizes.
+ * If the two sets are different sizes, the members beyond the end of
+ * the smaller set are compared against the empty set.
  */
 int set_test(struct set_t *a, struct set_t *b)
 {
@@ -368,7 +399,7 @@ int set_test(struct set_t *a, struct set_t *b)
         int i;
 
         rval = SET_EQUIVALENT;
-        i    = max(a->nwords, b->nwords);
+        i    = min(a->nwords, b->nwords);
         p1   = a->map;
         p2   = b->map;
 
@@ -387,6 +418,20 @@ int set_test(struct set_t *a, struct set_t *b)
                                 rval = SET_DISJOINT;
                 }
         }
+
+        /* Whatever remains of the larger set must be empty. */
+        if (a->nwords > b->nwords) {
+                for (i = a->nwords - b->nwords; i-->0; p1++) {
+                        if (*p1)
+                                rval = SET_DISJOINT;
+                }
+        } else {
+                for (i = b->nwords - a->nwords; i-->0; p2++) {
+                        if (*p2)
+                                rval = SET_DISJOINT;
+                }
+        }
+
         return rval;
 }
 
@@ -45,6 +45,7 @@ bool    set_contains(struct set_t *set, int val);
 
 /* Miscellaneous set functions. */
 int       next_member(struct set_t *set);
+uint64_t     set_hash(struct set_t *set);
 void        print_set(struct set_t *set);
 
 
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "set.h"
+#include "sparse.h"
+
+
+/**
+ * new_sparse
+ * ``````````
+ * Create a new, empty sparse set.
+ *
+ * @max  : Members are in [0, @max).
+ * Return: An initialized sparse set.
+ *
+ * NOTE
+ * The @sparse array doesn't need to be initialized for the membership
+ * test to work, but it is zeroed anyway to keep memory checkers quiet.
+ */
+struct sparse_t *new_sparse(int max)
+{
+        struct sparse_t *new;
+
+        if (!(new = malloc(sizeof(struct sparse_t))))
+                halt(SIGABRT, "new_sparse: Out of memory.\n");
+
+        new->n      = 0;
+        new->max    = max;
+        new->dense  = malloc(max * sizeof(int));
+        new->sparse = calloc(max, sizeof(int));
+
+        if (!new->dense || !new->sparse)
+                halt(SIGABRT, "new_sparse: Out of memory.\n");
+
+        return new;
+}
+
+
+/**
+ * del_sparse
+ * ``````````
+ * Free a sparse set.
+ */
+void del_sparse(struct sparse_t *s)
+{
+        free(s->dense);
+        free(s->sparse);
+        free(s);
+}
+
+
+/**
+ * sparse_load
+ * ```````````
+ * Replace the members of a sparse set with those of a bitset.
+ *
+ * @s    : Sparse set.
+ * @set  : Bitset; its members must be less than @s->max.
+ * Return: Nothing.
+ *
+ * NOTE
+ * Empty bytes of the bitmap are skipped whole, and the members are
+ * added in increasing order.
+ */
+void sparse_load(struct sparse_t *s, struct set_t *set)
+{
+        unsigned char byte;
+        int w;
+        int b;
+
+        sparse_clear(s);
+
+        for (w=0; w<set->nwords; w++) {
+                if (!(byte = set->map[w]))
+                        continue;
+                for (b=0; b<SEGSIZE; b++) {
+                        if (byte & (1 << b))
+                                sparse_add(s, w * SEGSIZE + b);
+                }
+        }
+}
+
+
+/**
+ * sparse_store
+ * ````````````
+ * Add the members of a sparse set to a bitset.
+ *
+ * @s    : Sparse set.
+ * @set  : Bitset; large enough to hold every member of @s.
+ * Return: Nothing.
+ */
+void sparse_store(struct sparse_t *s, struct set_t *set)
+{
+        int i;
+
+        for (i=0; i<s->n; i++)
+                set_add(set, s->dense[i]);
+}
@@ -0,0 +1,60 @@
+#ifndef _SPARSE_H
+#define _SPARSE_H
+
+#include <stdbool.h>
+
+#include "set.h"
+
+/******************************************************************************
+ * Sparse sets
+ * ```````````
+ * A set of integers in [0, max) kept as two arrays: @dense lists the
+ * members in the order they were added, and @sparse maps each member
+ * back to its slot in @dense. A value v is a member if and only if
+ *
+ *      sparse[v] < n && dense[sparse[v]] == v
+ *
+ * so the set can be cleared in O(1) by setting n to 0, and iterated in
+ * O(members) by walking dense[0..n), no matter how large @max is. The
+ * price is two ints per possible member, and no cheap equality test;
+ * use sparse_store() to get a canonical bitset for that.
+ *
+ * Iterating over @dense while adding members is well defined: new
+ * members are appended, and the walk picks them up.
+ ******************************************************************************/
+
+struct sparse_t {
+        int n;        // Number of members.
+        int max;      // Members are in [0, max).
+        int *dense;   // Members, in order of insertion.
+        int *sparse;  // Slot of each member in @dense.
+};
+
+
+struct sparse_t *new_sparse(int max);
+void             del_sparse(struct sparse_t *s);
+
+void sparse_load(struct sparse_t *s, struct set_t *set);
+void sparse_store(struct sparse_t *s, struct set_t *set);
+
+
+static inline bool sparse_contains(struct sparse_t *s, int v)
+{
+        return s->sparse[v] < s->n && s->dense[s->sparse[v]] == v;
+}
+
+static inline void sparse_add(struct sparse_t *s, int v)
+{
+        if (!sparse_contains(s, v)) {
+                s->dense[s->n] = v;
+                s->sparse[v]   = s->n++;
+        }
+}
+
+static inline void sparse_clear(struct sparse_t *s)
+{
+        s->n = 0;
+}
+
+
+#endif
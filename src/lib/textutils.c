@@ -298,8 +298,8 @@ void pumpf(char **strp, const char *fmt, ...)
  */
 void *textutils_memchr(const void *src_void, int c, size_t len)
 {
-        const int *src = (const int *)src_void;
-        int d = c;
+        const unsigned char *src = (const unsigned char *)src_void;
+        unsigned char d = c;
 
         #if !defined(PREFER_SIZE_OVER_SPEED) && !defined(__OPTIMIZE_SIZE__)
         unsigned long *asrc;
@@ -344,7 +344,7 @@ void *textutils_memchr(const void *src_void, int c, size_t len)
                  * If there are fewer than LONGBYTES characters left,
                  * we decay to the bytewise loop.
                  */
-                src = (int *)asrc;
+                src = (const unsigned char *)asrc;
         }
         #endif /* !PREFER_SIZE_OVER_SPEED */
 
@@ -992,7 +992,7 @@ int esc(char **s)
         register int rval;
 
         if (**s != '\\')
-                rval = *((*s)++);
+                rval = (unsigned char)*((*s)++);
         else {
                 ++(*s);
                 switch (toupper(**s))
@@ -1044,7 +1044,7 @@ int esc(char **s)
 
                 default:
                         if (!IS_OCTDIGIT(**s))
-                                rval = **s;
+                                rval = (unsigned char)**s;
                         else {
                                 ++(*s);
                                 rval = oct2bin(*(*s)++);
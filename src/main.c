@@ -39,17 +39,14 @@ void flex(struct pgen_t *pgen)
 /**
  * pgen
  * ````
- * Create the parser generator object and begin execution.
+ * Begin execution of the parser generator object.
  *
+ * @pgen  : parser generator, with its options set.
  * @input : input file.
  * @output: output file.
  */
-void do_pgen(FILE *input, FILE *output)
+void do_pgen(struct pgen_t *pgen, FILE *input, FILE *output)
 {
-        struct pgen_t *pgen;
-
-        pgen = calloc(1, sizeof(struct pgen_t));
-
         pgen->in  = input;
         pgen->out = output;
 
@@ -65,14 +62,30 @@ int main(int argc, char *argv[])
 {
         FILE *input_file = NULL;
         FILE *output_file = NULL;
+        struct pgen_t *pgen;
         char buf[1024];
         int c;
 
-        while ((c = getopt(argc, argv, "-m:o:")) != -1) {
+        if (!(pgen = calloc(1, sizeof(struct pgen_t))))
+                halt(SIGABRT, "Out of memory.\n");
+
+        while ((c = getopt(argc, argv, "-bcgkm:o:ruv")) != -1) {
                 switch (c) {
                 case 1:
                         input_file = sfopen(optarg, "r");
                         break;
+                case 'b':
+                        pgen->batch = true;
+                        break;
+                case 'c':
+                        pgen->table = TABLE_COMB;
+                        break;
+                case 'g':
+                        pgen->table = TABLE_DIRECT;
+                        break;
+                case 'k':
+                        pgen->keywords = true;
+                        break;
                 case 'm':
                         sprintf(buf, "gcc -static %s -L/usr/local/bin -linput -o y.out", optarg);
                         system(buf);
@@ -80,6 +93,15 @@ int main(int argc, char *argv[])
                 case 'o':
                         output_file = sfopen(optarg, "w");
                         break;
+                case 'r':
+                        pgen->table = TABLE_DEDUP;
+                        break;
+                case 'u':
+                        pgen->utf8 = true;
+                        break;
+                case 'v':
+                        pgen->verbose = true;
+                        break;
                 default:
                         break;
                 }
@@ -91,7 +113,7 @@ int main(int argc, char *argv[])
         if (!output_file)
                 output_file = stdout; 
 
-        do_pgen(input_file, output_file);
+        do_pgen(pgen, input_file, output_file);
 
         return 0;
 }
@@ -1,18 +1,39 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
+#include <stdio.h>
+#include <stdbool.h>
+
 /* 
  * Name of DFA transition table. Up to 3 characters are appended
  * to the end of this name in the row-compressed tables.
  */
 #define DTRAN_NAME "Yy_nxt"
+#define ECMAP_NAME "yy_ec"  // Name of the character class map.
+#define BASE_NAME  "Yy_base" // Row offsets into the comb-vector table.
+#define CHECK_NAME "Yy_chk"  // Owner of each comb-vector slot.
+#define DEF_NAME   "Yy_def"  // Default transition of each state.
+#define RMAP_NAME  "Yy_rmap" // Row of each state in the deduplicated table.
+#define CMAP_NAME  "yy_cmap" // Column of each character in the same.
+#define DISP_NAME  "Yy_kwd"  // Hash seed of each keyword bucket.
+#define KW_NAME    "Yy_kw"   // Keywords, by hash slot.
 #define TEMPLATE   "lex.par" // Driver template for the state machine.
 
-#define MAXLINE 2048 // Max rule/line size
 #ifndef PATHSIZE
 #define PATHSIZE 255
 #endif
 
+/**
+ * The layout of the transition table that is generated.
+ */
+enum table_t {
+        TABLE_DENSE,  // One row per state, one column per class.
+        TABLE_COMB,   // Comb-vector rows with a default per state (-c).
+        TABLE_DEDUP,  // Distinct rows and columns, through maps (-r).
+        TABLE_DIRECT  // No table; each state is a block of code (-g).
+};
+
+
 /**
  * The parser generator singleton.
  *
@@ -22,17 +43,31 @@
  *
  * @filename: name of the input file.
  * @line    : buffer holding the current line of input.
+ * @size    : allocated size of @line.
  * @cur     : pointer for traversing the line.
  * @in      : input file stream
  * @out     : output file stream
+ * @utf8    : expressions are UTF-8 text (-u)
+ * @table   : layout of the generated transition table
+ * @keywords: take keyword rules out into a hash table (-k)
+ * @kw      : the keywords that were taken out
+ * @batch   : leave the actions out, for yylex_batch() (-b)
+ * @verbose : report the sizes of the tables on stderr (-v)
  */
 struct pgen_t {
         char path_in[PATHSIZE];
         char path_out[PATHSIZE];
-        char line[MAXLINE]; 
+        char *line; 
+        size_t size;
         char *cur;
         FILE *in;
         FILE *out;
+        bool utf8;
+        enum table_t table;
+        bool keywords;
+        struct kwset_t *kw;
+        bool batch;
+        bool verbose;
 };
 
 
@@ -5,6 +5,7 @@
 #include "lib/debug.h"
 #include "lib/map.h"
 #include "lib/set.h"
+#include "lib/sparse.h"
 
 #include "lib/stack.h"
 #include "nfa.h"
@@ -21,7 +22,7 @@
  * ```````
  * Allocate and initialize a new NFA object.
  *
- * @max  : Maximum number of states in the NFA.
+ * @max  : Initial size of the state array.
  * Return: NFA object.
  */
 struct nfa_t *new_nfa(int max)
@@ -56,10 +57,10 @@ struct nfa_state *new_nfa_state(struct nfa_t *nfa)
         struct nfa_state *new;
 
         /* Allocate the new state */
-        if (!(new = malloc(sizeof(struct nfa_state))))
+        if (!(new = calloc(1, sizeof(struct nfa_state))))
                 halt(SIGABRT, "new_nfa: Out of memory.\n");
 
-        new->bitset = new_set(1024);
+        new->bitset = new_set(MAX_CHARS);
         new->edge   = EPSILON;
         new->id     = nfa->n;
 
@@ -67,6 +68,13 @@ struct nfa_state *new_nfa_state(struct nfa_t *nfa)
         if (new->id == 0)
                 nfa->start = new;
 
+        /* Grow the state array as needed. */
+        if (nfa->n == nfa->max) {
+                nfa->max *= 2;
+                if (!(nfa->state = realloc(nfa->state, nfa->max * sizeof(struct nfa_state *))))
+                        halt(SIGABRT, "new_nfa_state: Out of memory.\n");
+        }
+
         /* Add the state to the state array. */
         nfa->state[new->id] = new;
         nfa->n++;
@@ -130,13 +138,16 @@ char *save(char *str)
  * ````````
  * The main access routine. Creates an NFA using Thompson's construction.
  *
- * @input: File
+ * @input   : File
+ * @utf8    : Read the expressions as UTF-8 rather than as bytes.
+ * @keywords: Take keyword rules out of the NFA, see keywords().
  */
-struct nfa_t *thompson(FILE *input)
+struct nfa_t *thompson(FILE *input, bool utf8, bool keywords)
 {
         struct lexer_t *lex;
 
-        lex = new_lexer(input, MAXLINE, NFA_MAX);
+        lex = new_lexer(input, NFA_INIT, utf8);
+        lex->keywords = keywords;
 
         /* Manufacture the NFA */
         machine(lex); 
@@ -151,97 +162,158 @@ struct nfa_t *thompson(FILE *input)
  *****************************************************************************/
 
 
+/**
+ * closures
+ * ````````
+ * Compute, once, the epsilon closure of every NFA state that e_closure()
+ * can be asked about: the start state, and every state entered on a
+ * character or CCL edge.
+ *
+ * @nfa  : NFA object, as built by thompson().
+ * Return: Nothing; each such state gets its @closure, @nclosure and
+ *         @closure_accept fields filled in.
+ *
+ * NOTES
+ * Each closure is found with one walk of the epsilon edges, using a
+ * generation stamp to mark visited states, so the walk costs no more
+ * than the closure it produces. The closures are kept as lists of state
+ * ids rather than bitsets, so that their total size is that of the
+ * closures themselves and not |NFA| bits per state.
+ *
+ * The accepting state with the lowest id is saved with the closure, so
+ * e_closure() can resolve rule priority without looking at the states.
+ */
+void closures(struct nfa_t *nfa)
+{
+        struct nfa_state *p;
+        bool *kernel; // State is the start state or the target of a non-epsilon edge.
+        int *stamp;   // Last walk that visited each state.
+        int *stack;   // Walk stack; also collects the closure.
+        int top;
+        int n;
+        int i;
+        int k;
+
+        __ENTER;
+
+        kernel = calloc(nfa->n, sizeof(bool));
+        stamp  = calloc(nfa->n, sizeof(int));
+        stack  = malloc(nfa->n * sizeof(int));
+
+        if (!kernel || !stamp || !stack)
+                halt(SIGABRT, "closures: Out of memory.\n");
+
+        kernel[nfa->start->id] = true;
+
+        for (i=0; i<nfa->n; i++) {
+                p = nfa->state[i];
+                if (p->edge != EPSILON && p->edge != EMPTY && p->next)
+                        kernel[p->next->id] = true;
+        }
+
+        for (k=0; k<nfa->n; k++) {
+                if (!kernel[k])
+                        continue;
+
+                /* 
+                 * Walk from state k. The states below @top have been
+                 * visited; those from @top to @n are still to be walked.
+                 */
+                stack[0] = k;
+                stamp[k] = k + 1;
+                p        = nfa->state[k];
+
+                p->closure_accept = NULL;
+
+                for (top=0, n=1; top<n; top++) {
+                        p = nfa->state[stack[top]];
+
+                        if (p->accept && (!nfa->state[k]->closure_accept 
+                        || p->id < nfa->state[k]->closure_accept->id))
+                                nfa->state[k]->closure_accept = p;
+
+                        if (p->edge != EPSILON)
+                                continue;
+
+                        if (p->next && stamp[p->next->id] != k + 1) {
+                                stamp[p->next->id] = k + 1;
+                                stack[n++] = p->next->id;
+                        }
+                        if (p->next2 && stamp[p->next2->id] != k + 1) {
+                                stamp[p->next2->id] = k + 1;
+                                stack[n++] = p->next2->id;
+                        }
+                }
+
+                p = nfa->state[k];
+
+                if (!(p->closure = malloc(n * sizeof(int))))
+                        halt(SIGABRT, "closures: Out of memory.\n");
+
+                memcpy(p->closure, stack, n * sizeof(int));
+                p->nclosure = n;
+        }
+
+        free(kernel);
+        free(stamp);
+        free(stack);
+
+        __LEAVE;
+}
+
+
 /**
  * e_closure
  * `````````
  * Determine the set of states of NFA @nfa which can be reached from
- * a start state @nfa->start on epsilon transition.
+ * a set of states @input on epsilon transitions.
  *
- * @nfa   : NFA object. 
- * @T     : The set of start states over which to perform the closure. 
+ * @nfa   : NFA object, with closures() already computed.
+ * @input : The set of start states; the closure is added to it.
  * Return : A copy of the accepting state of the closure.
  *
  * CAVEAT 
- * Unlike move(), which considers transitions on a symbol, e_closure()
- * expects the symbol to be epsilon. Because epsilon transitions are
- * spontaneous, e_closure() does not share the requirement that only a 
- * single transition can be made on the input symbol.
- *
- * Because of this, it is a bit less trivial to construct the closure,
- * and a stack is required to manage the task effectively.
+ * Every state of @input must have had its closure computed by
+ * closures(); that is, it must be the start state or the target of
+ * a character or CCL edge, which is all move() ever returns.
  *
  * NOTES
+ * The closure of the set is the union of the precomputed closures of
+ * its members. Those are appended to @input as they are added, but
+ * only the original members need to be looked at, since the closure
+ * of anything in a closure is already part of it.
+ *
  * If there is no accepting state in the closure set, NULL is returned.
  * If the closure set contains more than one accepting state, the one
  * with the lowest NFA state id is returned. This way, conflicting states
  * that are higher in the input file will take precedence.
- *
- * accept_num holds the id of this last accepting state. If the current
- * state has a lower number, the other state is overwritten.
  */
-struct nfa_state *e_closure(struct nfa_t *nfa, struct set_t *input)
+struct nfa_state *e_closure(struct nfa_t *nfa, struct sparse_t *input)
 {
-        new_stack(stack, int, NFA_MAX);
-        int accept_num = 9999;
         struct nfa_state *accept = NULL;
         struct nfa_state *p;  
-        int i;               
+        int n;
+        int i;
+        int k;
 
         __ENTER;
 
-        if (!input)
-	        goto abort;
-
-        /* Push the input set onto the stack. */
-        for (next_member(NULL); ((i = next_member(input)) != -1);)
-                push(stack, i);
-
-        /* Main loop */
-        while (!stack_empty(stack)) {
+        for (n=input->n, k=0; k<n; k++) {
 
-                /* Get an NFA state. */
-	        i = pop(stack);
-	        p = nfa->state[i];
+	        p = nfa->state[input->dense[k]];
 
-                /* If state is accepting, save it. */
-	        if (p->accept && (i < accept_num)) {
-                        accept_num = i;
-                        accept     = p;
-	        }
+                /* If the closure is accepting, keep the lowest. */
+	        if (p->closure_accept 
+                && (!accept || p->closure_accept->id < accept->id))
+                        accept = p->closure_accept;
 
-	        if (p->edge == EPSILON) {
-
-	                if (p->next) {
-                                i = p->next->id;
-                                /* 
-                                 * If the input set does not contain
-                                 * the state being examined, add it
-                                 * to the input stack.
-                                 */
-                                if (!set_contains(input, i)) {
-                                        set_add(input, i);
-                                        push(stack, i);
-                                }
-	                }
-                        
-                        if (p->next2) {
-                                i = p->next2->id;
-                                /* 
-                                 * If the input set does not contain
-                                 * the state being examined, add it
-                                 * to the input stack.
-                                 */
-                                if (!set_contains(input, i)) {
-                                        set_add(input, i);
-                                        push(stack, i);
-                                }
-                        }
-	        }
+                for (i=0; i<p->nclosure; i++)
+                        sparse_add(input, p->closure[i]);
         }
 
-        abort:
-                __LEAVE;
-                return accept;
+        __LEAVE;
+
+        return accept;
 }
 
 
@@ -252,26 +324,38 @@ struct nfa_state *e_closure(struct nfa_t *nfa, struct set_t *input)
  * of states in NFA @nfa which are reachable from @input after a single
  * transition on @c.
  *
- * @nfa  : NFA object to traverse. 
- * @input: Set of states to check.
- * @c    : Input symbol to recognize.
- * Return: Set of NFA states.
+ * @nfa   : NFA object to traverse. 
+ * @input : Set of states to check.
+ * @c     : Input symbol to recognize.
+ * @cons  : The states with an edge on @c, in any order.
+ * @ncons : Number of states in @cons.
+ * @output: Set of NFA states (output; cleared first).
+ * Return : Number of states in @output.
+ *
+ * NOTE
+ * The result is the intersection of @input and @cons, followed across
+ * the edge. Whichever of the two is shorter is walked, testing each of
+ * its states against the other, so the cost is the smaller of the two
+ * and not the size of the NFA.
  */
-struct set_t *move(struct nfa_t *nfa, struct set_t *input, int c)
+int move(struct nfa_t *nfa, struct sparse_t *input, int c, int *cons, int ncons, struct sparse_t *output)
 {
-        struct set_t *output = NULL; // Output set
-        struct nfa_state *p;         // NFA state pointer. 
-        int i;
+        struct nfa_state *p; // NFA state pointer. 
+        int k;
 
         __ENTER;
 
-        /* For each state of the NFA */
-        for (i=0; i<nfa->n; i++) {
+        sparse_clear(output);
 
-                /* NFA state i is one of the input set. */
-	        if (set_contains(input, i)) {
+        if (ncons < input->n) {
+                for (k=0; k<ncons; k++) {
+                        if (sparse_contains(input, cons[k]))
+                                sparse_add(output, nfa->state[cons[k]]->next->id);
+                }
+        } else {
+                for (k=0; k<input->n; k++) {
 
-	                p = nfa->state[i];
+	                p = nfa->state[input->dense[k]];
 
                         /* 
                          * If NFA state i has an edge labeled 'c'
@@ -280,20 +364,85 @@ struct set_t *move(struct nfa_t *nfa, struct set_t *input, int c)
                          */
                         if (p->edge == c 
                         || (p->edge == CCL && set_contains(p->bitset, c))) 
-                        {
-                                /* Create the output set */
-                                if (!output)
-                                        output = new_set(255);
+                                sparse_add(output, p->next->id);
+                }
+        }
+
+        __LEAVE;
+
+        return output->n;
+}
 
-                                /* Add NFA state i to the output set. */
-                                set_add(output, p->next->id);
+
+/**
+ * nfa_match
+ * `````````
+ * Run the part of an NFA reachable from one state over a string.
+ *
+ * @nfa  : NFA object.
+ * @start: State to start in, usually the start state of one rule.
+ * @str  : String.
+ * @len  : Length of @str.
+ * @cur  : Scratch set of at least @nfa->n states.
+ * @next : Another one.
+ * Return: The accepting state with the lowest id reached at the end of
+ *         @str, or NULL if there is none.
+ *
+ * NOTE
+ * This is for checking a few strings against a rule while the NFA is
+ * still being built, so it uses no closures() and just walks the epsilon
+ * edges of each set, appending to it as it goes.
+ */
+struct nfa_state *nfa_match(struct nfa_t *nfa, struct nfa_state *start, unsigned char *str, int len,
+                            struct sparse_t *cur, struct sparse_t *next)
+{
+        struct nfa_state *accept;
+        struct nfa_state *p;
+        struct sparse_t *tmp;
+        int k;
+        int i;
+
+        sparse_clear(cur);
+        sparse_add(cur, start->id);
+
+        for (i=0; ; i++) {
+                for (k=0; k<cur->n; k++) {
+                        p = nfa->state[cur->dense[k]];
+
+                        if (p->edge == EPSILON) {
+                                if (p->next)
+                                        sparse_add(cur, p->next->id);
+                                if (p->next2)
+                                        sparse_add(cur, p->next2->id);
                         }
-	        }
+                }
+
+                if (i == len || cur->n == 0)
+                        break;
+
+                sparse_clear(next);
+
+                for (k=0; k<cur->n; k++) {
+                        p = nfa->state[cur->dense[k]];
+
+                        if (p->edge == str[i] 
+                        || (p->edge == CCL && set_contains(p->bitset, str[i])))
+                                sparse_add(next, p->next->id);
+                }
+
+                tmp  = cur;
+                cur  = next;
+                next = tmp;
         }
 
-        __LEAVE;
+        for (accept=NULL, k=0; k<cur->n; k++) {
+                p = nfa->state[cur->dense[k]];
+
+                if (p->accept && (!accept || p->id < accept->id))
+                        accept = p;
+        }
 
-        return output;
+        return (i == len) ? accept : NULL;
 }
 
 
@@ -312,10 +461,12 @@ void printccl(struct set_t *set)
         static int i;
 
         putchar('[');
-        for (i=0; i<=0x7f; i++) {
+        for (i=0; i<MAX_CHARS; i++) {
                 if (set_contains(set, i)) {
                         if (i < ' ')
                                 printf("^%c", i + '@');
+                        else if (i >= 0x7f)
+                                printf("\\x%02x", i);
                         else
                                 printf("%c", i);
                 }
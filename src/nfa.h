@@ -2,6 +2,7 @@
 #define _NFA_H 
 
 #include "lib/set.h"
+#include "lib/sparse.h"
 #include "lex.h"
 
 
@@ -10,16 +11,10 @@
  ******************************************************************************/
 
 /* 
- * Maximum number of states in a 
- * single finite state machine. 
+ * Initial size of the state array of an NFA.
+ * It is doubled whenever it fills up.
  */
-#define NFA_MAX 512 
-
-/* 
- * Total space that can be used by the 
- * accept strings. 
- */
-#define STR_MAX (10 * 1024)     
+#define NFA_INIT 512 
 
 
 /******************************************************************************
@@ -43,7 +38,11 @@ struct nfa_state {
         struct nfa_state *next;   // Next state (NULL if no next state).
         struct nfa_state *next2;  // Another next state if edge == EPSILON.
         char *accept;             // NULL if !accepting state, else the action.
+        int   rule;               // Number of the rule it accepts, counting from 1.
         int   anchor;             // Says whether pattern is anchored and where.
+        int  *closure;            // Epsilon closure (state ids), see closures().
+        int   nclosure;           // Number of states in @closure.
+        struct nfa_state *closure_accept; // Lowest accepting state in @closure.
 };
 
 
@@ -52,13 +51,14 @@ struct nfa_state {
  * ```
  * The actual automaton, containing a start state, a set of
  * NFA states, and book-keeping values for the total number
- * of states and the maximum allowable states of the machine.
+ * of states and the current capacity of the state array.
  */
 struct nfa_t {
         struct nfa_state *start;   // Address of start state.
         struct nfa_state **state;  // State array.
         int n;                     // Number of states allocated.
-        int max;                   // Maximum number of states.
+        int max;                   // Allocated size of the state array.
+        struct kwset_t *kw;        // Keyword rules taken out, see keywords().
 };
 
 
@@ -72,11 +72,14 @@ struct nfa_t *          new_nfa(int max);
 struct nfa_state *new_nfa_state(struct nfa_t *nfa);
 void                    del_nfa(struct nfa_state *doomed);
 
-struct nfa_t *thompson(FILE *input);
+struct nfa_t *thompson(FILE *input, bool utf8, bool keywords);
 char *            save(char *str);
 
-struct nfa_state *e_closure(struct nfa_t *nfa, struct set_t *input);
-struct set_t          *move(struct nfa_t *nfa, struct set_t *input, int c);
+void                closures(struct nfa_t *nfa);
+struct nfa_state *e_closure(struct nfa_t *nfa, struct sparse_t *input);
+int                    move(struct nfa_t *nfa, struct sparse_t *input, int c, int *cons, int ncons, struct sparse_t *output);
+struct nfa_state *nfa_match(struct nfa_t *nfa, struct nfa_state *start, unsigned char *str, int len,
+                            struct sparse_t *cur, struct sparse_t *next);
 
 void print_nfa(struct nfa_t *nfa);
 
@@ -18,51 +18,6 @@
  */
 
 
-/**
- * get_expr
- * ````````
- * Get a regular expression and associated string from the input stream.
- *
- * @pgen    : Parser generator singleton object. 
- * Return   : Pointer to the line containing the regex and string in it.
- *
- * NOTE
- * Discards all blank lines and concatenates all whitespace-separated strings.
- */
-char *get_expr(struct pgen_t *pgen)
-{
-        static int lookahead = 0;
-        size_t size;
-        char *line;
-
-        size = MAXLINE;
-
-        /* If the next line starts with %, return the EOF marker. */
-        if (lookahead == '%')	
-                return NULL;
-
-        while ((lookahead = getstr(&line, &size, pgen->in)) != EOF) {
-                if (lookahead == 0)
-	                halt(SIGABRT, "Rule too long\n");
-
-                /* Ignore blank lines. */
-	        if (!line[0])
-	                continue;
-
-	        size = MAXLINE - (line - pgen->line);
-
-                /* Ignore whitespace */
-	        if (!isspace(lookahead))
-	                break;
-
-	        *line++ = '\n';
-        }
-
-        return lookahead ? line : NULL;
-}
-
-
-
 /**
  * scan_head
  * `````````
@@ -89,7 +44,7 @@ void scan_head(struct pgen_t *pgen)
         /* ignore becomes true inside a %{ ... %} block. */
         bool ignore = false;
        
-        while (fgets(pgen->line, MAXLINE, pgen->in)) {
+        while (getstr(&pgen->line, &pgen->size, pgen->in) != -1) {
 
 	        if (!ignore)	
 	                strip_comments(pgen->line);	
@@ -134,7 +89,7 @@ void scan_head(struct pgen_t *pgen)
  */
 void scan_tail(struct pgen_t *pgen)
 {
-        while (fgets(pgen->line, MAXLINE, pgen->in))
+        while (getstr(&pgen->line, &pgen->size, pgen->in) != -1)
 	        fputs(pgen->line, pgen->out);
 }
 
@@ -0,0 +1,543 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lib/debug.h"
+#include "lib/set.h"
+#include "nfa.h"
+#include "utf8.h"
+
+/******************************************************************************
+ * UTF-8
+ *
+ * The DFA is built over bytes, so a class of code points has to be spelled
+ * out as the byte sequences that encode it. Each range of code points is
+ * split until every piece encodes to sequences of the same length whose
+ * bytes vary independently, e.g.
+ *
+ *      U+0400-U+04FF   -->   [D0-D3][80-BF]
+ *
+ * and the pieces are joined in a trie keyed on byte ranges, so that common
+ * lead bytes share one NFA state. Common suffixes are left for minimize()
+ * to merge once the DFA is built.
+ *
+ * Only shortest-form encodings of scalar values are generated, so overlong
+ * forms, surrogates, and stray continuation bytes have no transition and
+ * are rejected by the same DFA pass that recognizes everything else.
+ *
+ *****************************************************************************/
+
+
+/******************************************************************************
+ * CHARACTER CLASSES
+ ******************************************************************************/
+
+/**
+ * new_ccl
+ * ```````
+ * Allocate an empty character class.
+ *
+ * Return: Pointer to the class.
+ */
+struct ccl_t *new_ccl(void)
+{
+        struct ccl_t *new;
+
+        if (!(new = calloc(1, sizeof(struct ccl_t))))
+                halt(SIGABRT, "new_ccl: Out of memory.\n");
+
+        new->max = 8;
+
+        if (!(new->range = malloc(new->max * sizeof(struct range_t))))
+                halt(SIGABRT, "new_ccl: Out of memory.\n");
+
+        return new;
+}
+
+
+/**
+ * del_ccl
+ * ```````
+ * Free a character class.
+ */
+void del_ccl(struct ccl_t *ccl)
+{
+        free(ccl->range);
+        free(ccl);
+}
+
+
+/**
+ * ccl_add
+ * ```````
+ * Add the characters in [@lo, @hi] to a character class.
+ *
+ * @ccl  : Character class.
+ * @lo   : First character of the range.
+ * @hi   : Last character of the range.
+ * Return: Nothing.
+ */
+void ccl_add(struct ccl_t *ccl, int lo, int hi)
+{
+        if (lo > hi)
+                return;
+
+        if (ccl->n == ccl->max) {
+                ccl->max *= 2;
+                if (!(ccl->range = realloc(ccl->range, ccl->max * sizeof(struct range_t))))
+                        halt(SIGABRT, "ccl_add: Out of memory.\n");
+        }
+
+        ccl->range[ccl->n].lo = lo;
+        ccl->range[ccl->n].hi = hi;
+        ccl->n++;
+}
+
+
+/* qsort comparator ordering ranges by their first character. */
+static int range_cmp(const void *a, const void *b)
+{
+        return ((struct range_t *)a)->lo - ((struct range_t *)b)->lo;
+}
+
+
+/**
+ * ccl_normalize
+ * `````````````
+ * Sort the ranges of a character class, and merge any that overlap or
+ * touch, so that they are disjoint and in increasing order.
+ */
+void ccl_normalize(struct ccl_t *ccl)
+{
+        int i;
+        int n;
+
+        if (ccl->n == 0)
+                return;
+
+        qsort(ccl->range, ccl->n, sizeof(struct range_t), range_cmp);
+
+        for (n=0, i=1; i<ccl->n; i++) {
+                if (ccl->range[i].lo <= ccl->range[n].hi + 1) {
+                        if (ccl->range[i].hi > ccl->range[n].hi)
+                                ccl->range[n].hi = ccl->range[i].hi;
+                } else {
+                        ccl->range[++n] = ccl->range[i];
+                }
+        }
+        ccl->n = n + 1;
+}
+
+
+/**
+ * ccl_complement
+ * ``````````````
+ * Replace a character class with its complement over [0, @max].
+ *
+ * @ccl  : Character class.
+ * @max  : Last character of the alphabet.
+ * Return: Nothing.
+ */
+void ccl_complement(struct ccl_t *ccl, int max)
+{
+        struct ccl_t *gaps;
+        int next = 0;
+        int i;
+
+        ccl_normalize(ccl);
+
+        gaps = new_ccl();
+
+        for (i=0; i<ccl->n && next <= max; i++) {
+                ccl_add(gaps, next, (ccl->range[i].lo <= max) ? ccl->range[i].lo - 1 : max);
+                next = ccl->range[i].hi + 1;
+        }
+        ccl_add(gaps, next, max);
+
+        free(ccl->range);
+        *ccl = *gaps;
+        free(gaps);
+}
+
+
+/******************************************************************************
+ * ENCODING
+ ******************************************************************************/
+
+/**
+ * utf8_decode
+ * ```````````
+ * Decode one code point from a UTF-8 string.
+ *
+ * @s    : Pointer to the string, advanced past the sequence on success.
+ * Return: The code point, or -1 if the sequence is malformed.
+ *
+ * NOTES
+ * Overlong forms, surrogates, and values past U+10FFFF are malformed.
+ */
+int utf8_decode(char **s)
+{
+        static const int least[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        unsigned char *p = (unsigned char *)*s;
+        int c;
+        int n;
+        int i;
+
+        if (p[0] < 0x80) {
+                c = p[0];
+                n = 1;
+        } else if ((p[0] & 0xE0) == 0xC0) {
+                c = p[0] & 0x1F;
+                n = 2;
+        } else if ((p[0] & 0xF0) == 0xE0) {
+                c = p[0] & 0x0F;
+                n = 3;
+        } else if ((p[0] & 0xF8) == 0xF0) {
+                c = p[0] & 0x07;
+                n = 4;
+        } else {
+                return -1;
+        }
+
+        for (i=1; i<n; i++) {
+                if ((p[i] & 0xC0) != 0x80)
+                        return -1;
+                c = (c << 6) | (p[i] & 0x3F);
+        }
+
+        if (c < least[n] || c > UTF8_MAX || (c >= SURROGATE_LO && c <= SURROGATE_HI))
+                return -1;
+
+        *s += n;
+
+        return c;
+}
+
+
+/**
+ * utf8_encode
+ * ```````````
+ * Encode a code point as UTF-8.
+ *
+ * @c    : Code point.
+ * @buf  : Output buffer of at least UTF8_LEN_MAX bytes.
+ * Return: Number of bytes written.
+ */
+int utf8_encode(int c, unsigned char *buf)
+{
+        if (c < 0x80) {
+                buf[0] = c;
+                return 1;
+        }
+        if (c < 0x800) {
+                buf[0] = 0xC0 | (c >> 6);
+                buf[1] = 0x80 | (c & 0x3F);
+                return 2;
+        }
+        if (c < 0x10000) {
+                buf[0] = 0xE0 | (c >> 12);
+                buf[1] = 0x80 | ((c >> 6) & 0x3F);
+                buf[2] = 0x80 | (c & 0x3F);
+                return 3;
+        }
+        buf[0] = 0xF0 | (c >> 18);
+        buf[1] = 0x80 | ((c >> 12) & 0x3F);
+        buf[2] = 0x80 | ((c >> 6) & 0x3F);
+        buf[3] = 0x80 | (c & 0x3F);
+        return 4;
+}
+
+
+/******************************************************************************
+ * BYTE-SEQUENCE TRIE
+ ******************************************************************************/
+
+/**
+ * utf8_node
+ * `````````
+ * One byte range in the trie of encoded sequences. The children of a
+ * node are the ranges allowed for the following byte; a node without
+ * children ends a sequence.
+ */
+struct utf8_node {
+        int lo;
+        int hi;
+        struct utf8_node *child;
+        struct utf8_node *sibling;
+};
+
+
+/**
+ * utf8_insert
+ * ```````````
+ * Add a sequence of byte ranges to the trie, sharing any prefix that
+ * is already present.
+ *
+ * @root : Root of the trie.
+ * @lo   : Low byte of each position.
+ * @hi   : High byte of each position.
+ * @n    : Length of the sequence.
+ * Return: Nothing.
+ */
+static void utf8_insert(struct utf8_node *root, unsigned char *lo, unsigned char *hi, int n)
+{
+        struct utf8_node **link;
+        struct utf8_node *node = root;
+        int i;
+
+        for (i=0; i<n; i++) {
+                for (link = &node->child; *link; link = &(*link)->sibling) {
+                        if ((*link)->lo == lo[i] && (*link)->hi == hi[i])
+                                break;
+                }
+                if (!*link) {
+                        if (!(*link = calloc(1, sizeof(struct utf8_node))))
+                                halt(SIGABRT, "utf8_insert: Out of memory.\n");
+                        (*link)->lo = lo[i];
+                        (*link)->hi = hi[i];
+                }
+                node = *link;
+        }
+}
+
+
+/**
+ * utf8_split
+ * ``````````
+ * Split the code points [@lo, @hi] into pieces whose encodings are the
+ * cross product of one byte range per position, and add each piece to
+ * the trie.
+ *
+ * @root : Root of the trie.
+ * @lo   : First code point.
+ * @hi   : Last code point.
+ * Return: Nothing.
+ *
+ * NOTES
+ * A piece must not straddle a change in encoded length, and every byte
+ * after the first position at which @lo and @hi differ must range over
+ * all continuation bytes 0x80-0xBF. Otherwise the range is cut at the
+ * offending boundary and each half is handled in turn.
+ */
+static void utf8_split(struct utf8_node *root, int lo, int hi)
+{
+        static const int last[] = { 0x7F, 0x7FF, 0xFFFF };
+        unsigned char blo[UTF8_LEN_MAX];
+        unsigned char bhi[UTF8_LEN_MAX];
+        int m;
+        int n;
+        int i;
+
+        if (lo > hi)
+                return;
+
+        if (lo <= SURROGATE_HI && hi >= SURROGATE_LO) {
+                utf8_split(root, lo, SURROGATE_LO - 1);
+                utf8_split(root, SURROGATE_HI + 1, hi);
+                return;
+        }
+
+        for (i=0; i<3; i++) {
+                if (lo <= last[i] && hi > last[i]) {
+                        utf8_split(root, lo, last[i]);
+                        utf8_split(root, last[i] + 1, hi);
+                        return;
+                }
+        }
+
+        n = utf8_encode(lo, blo);
+        utf8_encode(hi, bhi);
+
+        for (i=1; i<n; i++) {
+                m = (1 << (6 * i)) - 1;
+
+                if ((lo & ~m) != (hi & ~m)) {
+                        if ((lo & m) != 0) {
+                                utf8_split(root, lo, lo | m);
+                                utf8_split(root, (lo | m) + 1, hi);
+                                return;
+                        }
+                        if ((hi & m) != m) {
+                                utf8_split(root, lo, (hi & ~m) - 1);
+                                utf8_split(root, hi & ~m, hi);
+                                return;
+                        }
+                }
+        }
+
+        utf8_insert(root, blo, bhi, n);
+}
+
+
+/**
+ * utf8_free
+ * `````````
+ * Free the nodes of a trie below (and not including) its root.
+ */
+static void utf8_free(struct utf8_node *node)
+{
+        struct utf8_node *next;
+
+        for (; node; node = next) {
+                next = node->sibling;
+                utf8_free(node->child);
+                free(node);
+        }
+}
+
+
+/******************************************************************************
+ * NFA CONSTRUCTION
+ ******************************************************************************/
+
+/**
+ * utf8_fork
+ * `````````
+ * Join two alternatives under an epsilon state. Either may be NULL.
+ */
+static struct nfa_state *utf8_fork(struct nfa_t *nfa, struct nfa_state *a, struct nfa_state *b)
+{
+        struct nfa_state *fork;
+
+        if (!a || !b)
+                return (a) ? a : b;
+
+        fork        = new_nfa_state(nfa);
+        fork->next  = a;
+        fork->next2 = b;
+
+        return fork;
+}
+
+
+/**
+ * utf8_emit
+ * `````````
+ * Build the NFA states for a list of sibling trie nodes and everything
+ * below them.
+ *
+ * @nfa  : NFA object.
+ * @node : First of the siblings.
+ * @end  : State reached after the last byte of every sequence.
+ * Return: Start state of the alternatives.
+ */
+static struct nfa_state *utf8_emit(struct nfa_t *nfa, struct utf8_node *node, struct nfa_state *end)
+{
+        struct nfa_state *alt = NULL;
+        struct nfa_state *s;
+        int c;
+
+        for (; node; node = node->sibling) {
+                s = new_nfa_state(nfa);
+
+                if (node->lo == node->hi) {
+                        s->edge = node->lo;
+                } else {
+                        s->edge = CCL;
+                        for (c=node->lo; c<=node->hi; c++)
+                                set_add(s->bitset, c);
+                }
+
+                s->next = (node->child) ? utf8_emit(nfa, node->child, end) : end;
+                alt     = utf8_fork(nfa, alt, s);
+        }
+
+        return alt;
+}
+
+
+/**
+ * utf8_literal
+ * ````````````
+ * Construct a state machine matching the UTF-8 encoding of one code point.
+ *
+ * @nfa   : NFA object.
+ * @c     : Code point.
+ * @startp: Start state of the machine (output).
+ * @endp  : End state of the machine (output).
+ * Return : Nothing.
+ */
+void utf8_literal(struct nfa_t *nfa, int c, struct nfa_state **startp, struct nfa_state **endp)
+{
+        unsigned char buf[UTF8_LEN_MAX];
+        struct nfa_state *s;
+        int n;
+        int i;
+
+        n = utf8_encode(c, buf);
+
+        *startp = s = new_nfa_state(nfa);
+
+        for (i=0; i<n; i++) {
+                s->edge = buf[i];
+                s->next = new_nfa_state(nfa);
+                s       = s->next;
+        }
+
+        *endp = s;
+}
+
+
+/**
+ * utf8_machine
+ * ````````````
+ * Construct a state machine matching the UTF-8 encoding of any code
+ * point in a character class.
+ *
+ * @nfa   : NFA object.
+ * @ccl   : Character class of code points.
+ * @startp: Start state of the machine (output).
+ * @endp  : End state of the machine (output).
+ * Return : Nothing.
+ *
+ * NOTES
+ * All single-byte members are gathered on one CCL edge; the multi-byte
+ * members hang off the byte-range trie.
+ */
+void utf8_machine(struct nfa_t *nfa, struct ccl_t *ccl, struct nfa_state **startp, struct nfa_state **endp)
+{
+        struct utf8_node root = { 0 };
+        struct nfa_state *ascii = NULL;
+        struct nfa_state *start;
+        int lo;
+        int hi;
+        int i;
+        int c;
+
+        ccl_normalize(ccl);
+
+        *endp = new_nfa_state(nfa);
+
+        for (i=0; i<ccl->n; i++) {
+                lo = ccl->range[i].lo;
+                hi = ccl->range[i].hi;
+
+                if (lo < UTF8_SELF) {
+                        if (!ascii) {
+                                ascii       = new_nfa_state(nfa);
+                                ascii->edge = CCL;
+                                ascii->next = *endp;
+                        }
+                        for (c=lo; c<=hi && c<UTF8_SELF; c++)
+                                set_add(ascii->bitset, c);
+
+                        lo = UTF8_SELF;
+                }
+
+                utf8_split(&root, lo, (hi < UTF8_MAX) ? hi : UTF8_MAX);
+        }
+
+        start = utf8_fork(nfa, ascii, utf8_emit(nfa, root.child, *endp));
+
+        /* An empty class still needs an edge; it just never matches. */
+        if (!start) {
+                start       = new_nfa_state(nfa);
+                start->edge = CCL;
+                start->next = *endp;
+        }
+
+        *startp = start;
+
+        utf8_free(root.child);
+}
@@ -0,0 +1,59 @@
+#ifndef _UTF8_H
+#define _UTF8_H
+
+#include "nfa.h"
+
+
+/******************************************************************************
+ * CONSTANTS
+ ******************************************************************************/
+
+#define UTF8_MAX      0x10FFFF // Largest Unicode code point.
+#define UTF8_SELF     0x80     // Code points below this are a single byte.
+#define SURROGATE_LO  0xD800   // Surrogate halves are not scalar values,
+#define SURROGATE_HI  0xDFFF   // and have no valid UTF-8 encoding.
+#define UTF8_LEN_MAX  4        // Longest encoded sequence, in bytes.
+
+
+/******************************************************************************
+ * CHARACTER CLASSES
+ ******************************************************************************/
+
+/**
+ * ccl_t
+ * `````
+ * A character class as a list of closed ranges [lo, hi] of characters.
+ * Unlike a bitset, the ranges can span the full code point space, so
+ * the same object serves for byte classes and for UTF-8 classes.
+ */
+struct range_t {
+        int lo;
+        int hi;
+};
+
+struct ccl_t {
+        struct range_t *range;  // Ranges, sorted and disjoint once normalized.
+        int n;                  // Number of ranges.
+        int max;                // Allocated size of the range array.
+};
+
+
+struct ccl_t *new_ccl(void);
+void          del_ccl(struct ccl_t *ccl);
+void          ccl_add(struct ccl_t *ccl, int lo, int hi);
+void          ccl_normalize(struct ccl_t *ccl);
+void          ccl_complement(struct ccl_t *ccl, int max);
+
+
+/******************************************************************************
+ * UTF-8
+ ******************************************************************************/
+
+int  utf8_decode(char **s);
+int  utf8_encode(int c, unsigned char *buf);
+
+void utf8_literal(struct nfa_t *nfa, int c, struct nfa_state **startp, struct nfa_state **endp);
+void utf8_machine(struct nfa_t *nfa, struct ccl_t *ccl, struct nfa_state **startp, struct nfa_state **endp);
+
+
+#endif